@@ -0,0 +1,83 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <smartIdEngine/smartid_result.h>
+
+/*****************************************************************************
+ SESIDImageFieldStore holds a single, best-quality version of each image
+ field seen during a session. Quality is the field confidence multiplied by
+ image sharpness (mean absolute gradient), so a field image is copied into
+ the store only when it's better than the stored one. Stored fields are
+ shared through immutable handles instead of being copied into each result.
+ 
+ Thread-safe.
+*****************************************************************************/
+
+class SESIDImageFieldStore {
+public:
+  typedef std::shared_ptr<const se::smartid::ImageField> ImageFieldHandle;
+
+  /**
+   * @brief Stores the field if there is no field with such name or if the
+   *        field has better quality than the stored one
+   * @return true if the field was stored
+   */
+  bool Update(const se::smartid::ImageField &field);
+
+  /// Stored field handle, null if there is no field with such name
+  ImageFieldHandle Get(const std::string &name) const;
+
+  /// Names of stored fields
+  std::vector<std::string> GetNames() const;
+
+  /// Memory held by stored images in bytes
+  size_t GetMemoryUsage() const;
+
+  void Clear();
+
+  /// Quality score used to select the best field version
+  static double Quality(const se::smartid::ImageField &field);
+
+  /// Mean absolute horizontal and vertical gradient of the first channel
+  static double Sharpness(const se::smartid::Image &image);
+
+private:
+  struct Entry {
+    ImageFieldHandle field;
+    double quality;
+  };
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+};
@@ -0,0 +1,102 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDImageFieldStore.h"
+
+#include <cstdlib>
+
+bool SESIDImageFieldStore::Update(const se::smartid::ImageField &field) {
+  const double quality = Quality(field);
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = entries_.find(field.GetName());
+  if (it != entries_.end() && it->second.quality >= quality) {
+    return false;
+  }
+  
+  // copying the image only when the stored version is replaced
+  Entry entry = {std::make_shared<const se::smartid::ImageField>(field), quality};
+  entries_[field.GetName()] = entry;
+  return true;
+}
+
+SESIDImageFieldStore::ImageFieldHandle SESIDImageFieldStore::Get(const std::string &name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return ImageFieldHandle();
+  }
+  return it->second.field;
+}
+
+std::vector<std::string> SESIDImageFieldStore::GetNames() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> names;
+  for (const auto &entry : entries_) {
+    names.push_back(entry.first);
+  }
+  return names;
+}
+
+size_t SESIDImageFieldStore::GetMemoryUsage() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t usage = 0;
+  for (const auto &entry : entries_) {
+    const se::smartid::Image &image = entry.second.field->GetValue();
+    usage += (size_t)image.stride * image.height;
+  }
+  return usage;
+}
+
+void SESIDImageFieldStore::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+}
+
+double SESIDImageFieldStore::Quality(const se::smartid::ImageField &field) {
+  return field.GetConfidence() * Sharpness(field.GetValue());
+}
+
+double SESIDImageFieldStore::Sharpness(const se::smartid::Image &image) {
+  if (!image.data || image.width < 2 || image.height < 2 || image.channels < 1) {
+    return 0.0;
+  }
+  
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(image.data);
+  const int step = image.channels;
+  double gradientSum = 0.0;
+  for (int y = 0; y + 1 < image.height; ++y) {
+    const unsigned char *row = data + (size_t)y * image.stride;
+    const unsigned char *nextRow = row + image.stride;
+    for (int x = 0; x + 1 < image.width; ++x) {
+      const int pixel = row[x * step];
+      gradientSum += std::abs(row[(x + 1) * step] - pixel) + std::abs(nextRow[x * step] - pixel);
+    }
+  }
+  return gradientSum / (2.0 * (image.width - 1) * (image.height - 1));
+}
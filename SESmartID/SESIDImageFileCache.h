@@ -0,0 +1,69 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#include <memory>
+
+#include <smartIdEngine/smartid_common.h>
+
+/*****************************************************************************
+ SESIDImageFileCache keeps decoded images in LRU order keyed by file path,
+ modification date and requested resolution, up to a memory limit.
+ 
+ Reduced-resolution images are decoded with ImageIO thumbnailing which uses
+ DCT scaling for JPEG files, full-resolution images are decoded by
+ se::smartid::Image.
+*****************************************************************************/
+
+@interface SESIDImageFileCache : NSObject
+
+@property (atomic, assign) size_t memoryLimit; // in bytes, 256 MB by default
+
+@property (atomic, readonly) NSUInteger hitsCount;
+@property (atomic, readonly) NSUInteger missesCount;
+
+- (id) init;
+
+- (id) initWithMemoryLimit:(size_t)memoryLimit;
+
+// returns cached image or decodes it, maxDimension limits the larger side
+// of the image (0 means full resolution)
+// throws std::exception if image can't be decoded
+- (std::shared_ptr<const se::smartid::Image>) imageForFile:(NSString *)imageFile
+                                              maxDimension:(int)maxDimension;
+
+// decodes images concurrently and puts them into cache, errors are logged
+- (void) prefetchImageFiles:(NSArray<NSString *> *)imageFiles
+               maxDimension:(int)maxDimension;
+
+- (size_t) memoryUsage;
+
+- (void) removeAllImages;
+
+@end
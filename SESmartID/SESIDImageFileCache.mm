@@ -0,0 +1,197 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SESIDImageFileCache.h"
+
+#import <ImageIO/ImageIO.h>
+
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct CachedImage {
+  std::string key;
+  std::shared_ptr<const se::smartid::Image> image;
+  size_t size;
+};
+
+size_t ImageSize(const se::smartid::Image &image) {
+  return (size_t)image.stride * image.height;
+}
+
+// decodes reduced-resolution BGRA image, ImageIO skips DCT coefficients
+// for JPEG images when the requested size allows it
+std::shared_ptr<const se::smartid::Image> DecodeImage(NSString *imageFile, int maxDimension) {
+  NSURL *url = [NSURL fileURLWithPath:imageFile];
+  CGImageSourceRef source = CGImageSourceCreateWithURL((__bridge CFURLRef)url, NULL);
+  if (!source) {
+    throw std::runtime_error("Failed to open image file " + std::string(imageFile.UTF8String));
+  }
+  
+  NSDictionary *options = @{(NSString *)kCGImageSourceCreateThumbnailFromImageAlways: @YES,
+                            (NSString *)kCGImageSourceThumbnailMaxPixelSize: @(maxDimension),
+                            (NSString *)kCGImageSourceShouldCache: @NO};
+  CGImageRef cgImage = CGImageSourceCreateThumbnailAtIndex(source, 0,
+                                                           (__bridge CFDictionaryRef)options);
+  CFRelease(source);
+  if (!cgImage) {
+    throw std::runtime_error("Failed to decode image file " + std::string(imageFile.UTF8String));
+  }
+  
+  const size_t width = CGImageGetWidth(cgImage);
+  const size_t height = CGImageGetHeight(cgImage);
+  const size_t stride = width * 4;
+  std::vector<unsigned char> data(stride * height);
+  
+  CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+  CGContextRef context = CGBitmapContextCreate(data.data(), width, height, 8, stride, colorSpace,
+                                               kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst);
+  CGColorSpaceRelease(colorSpace);
+  if (context) {
+    CGContextDrawImage(context, CGRectMake(0, 0, width, height), cgImage);
+    CGContextRelease(context);
+  }
+  CGImageRelease(cgImage);
+  if (!context) {
+    throw std::runtime_error("Failed to create bitmap context for " + std::string(imageFile.UTF8String));
+  }
+  
+  return std::make_shared<const se::smartid::Image>(data.data(), data.size(),
+                                                    (int)width, (int)height, (int)stride, 4);
+}
+
+} // namespace
+
+@interface SESIDImageFileCache() {
+  std::mutex mutex_;
+  std::list<CachedImage> images_; // most recently used first
+  std::unordered_map<std::string, std::list<CachedImage>::iterator> index_;
+  size_t memoryUsage_;
+}
+
+@property (atomic, readwrite) NSUInteger hitsCount;
+@property (atomic, readwrite) NSUInteger missesCount;
+
+@end
+
+@implementation SESIDImageFileCache
+
+- (id) init {
+  return [self initWithMemoryLimit:256 * 1024 * 1024];
+}
+
+- (id) initWithMemoryLimit:(size_t)memoryLimit {
+  if (self = [super init]) {
+    self.memoryLimit = memoryLimit;
+    memoryUsage_ = 0;
+  }
+  return self;
+}
+
+- (std::shared_ptr<const se::smartid::Image>) imageForFile:(NSString *)imageFile
+                                              maxDimension:(int)maxDimension {
+  NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:imageFile
+                                                                              error:nil];
+  if (!attributes) {
+    throw std::invalid_argument("Image file does not exist: " + std::string(imageFile.UTF8String));
+  }
+  
+  const double modificationTime = [attributes.fileModificationDate timeIntervalSince1970];
+  NSString *key = [NSString stringWithFormat:@"%@|%f|%d", imageFile, modificationTime, maxDimension];
+  const std::string cacheKey = key.UTF8String;
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = index_.find(cacheKey);
+    if (it != index_.end()) {
+      images_.splice(images_.begin(), images_, it->second);
+      ++self.hitsCount;
+      return it->second->image;
+    }
+  }
+  
+  // decoding without holding the lock so that files are decoded concurrently
+  std::shared_ptr<const se::smartid::Image> image;
+  if (maxDimension > 0) {
+    image = DecodeImage(imageFile, maxDimension);
+  } else {
+    image = std::make_shared<const se::smartid::Image>(std::string(imageFile.UTF8String));
+  }
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++self.missesCount;
+  if (index_.find(cacheKey) == index_.end()) {
+    CachedImage cached = {cacheKey, image, ImageSize(*image)};
+    images_.push_front(cached);
+    index_[cacheKey] = images_.begin();
+    memoryUsage_ += cached.size;
+    [self evictToMemoryLimit];
+  }
+  return image;
+}
+
+- (void) prefetchImageFiles:(NSArray<NSString *> *)imageFiles
+               maxDimension:(int)maxDimension {
+  dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+  dispatch_apply(imageFiles.count, queue, ^(size_t i) {
+    try {
+      [self imageForFile:imageFiles[i] maxDimension:maxDimension];
+    } catch (const std::exception &e) {
+      NSLog(@"Exception thrown during image prefetch: %s", e.what());
+    }
+  });
+}
+
+- (size_t) memoryUsage {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return memoryUsage_;
+}
+
+- (void) removeAllImages {
+  std::lock_guard<std::mutex> lock(mutex_);
+  images_.clear();
+  index_.clear();
+  memoryUsage_ = 0;
+}
+
+// must be called with mutex_ held, the most recent image is always kept
+- (void) evictToMemoryLimit {
+  while (memoryUsage_ > self.memoryLimit && images_.size() > 1) {
+    const CachedImage &last = images_.back();
+    memoryUsage_ -= last.size;
+    index_.erase(last.key);
+    images_.pop_back();
+  }
+}
+
+@end
@@ -0,0 +1,65 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import <Foundation/Foundation.h>
+
+#include <smartIdEngine/smartid_result.h>
+
+/*****************************************************************************
+ SESIDMrzResultCache keeps validated MRZ recognition results keyed by
+ document type and checksum-protected MRZ fields (document number, birth date
+ and expiry date). When the same MRZ is read again, by the same or another
+ session, the validated result is reused instead of waiting for
+ the session to integrate enough frames.
+ 
+ Thread-safe, one instance can be shared by several recognition cores.
+*****************************************************************************/
+
+@interface SESIDMrzResultCache : NSObject
+
+@property (atomic, assign) NSUInteger capacity; // maximum number of results, 64 by default
+
+@property (atomic, readonly) NSUInteger hitsCount;
+@property (atomic, readonly) NSUInteger missesCount;
+
+- (id) init;
+
+// stores result if it is an MRZ result with all string fields accepted, image fields
+// are not stored
+- (void) storeResult:(const se::smartid::RecognitionResult &)result;
+
+// looks up validated result for the MRZ read in the given (intermediate) result
+// returns NO if result is not an MRZ result or if its key fields are not accepted yet
+- (BOOL) findValidatedResult:(se::smartid::RecognitionResult &)validatedResult
+                   forResult:(const se::smartid::RecognitionResult &)result;
+
+- (double) hitRate;
+
+- (void) removeAllResults;
+
+@end
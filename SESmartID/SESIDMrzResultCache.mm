@@ -0,0 +1,163 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#import "SESIDMrzResultCache.h"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// fields protected by MRZ check digits
+const char* const kMrzKeyFields[] = {"number", "birth_date", "expiry_date"};
+
+bool IsMrzResult(const se::smartid::RecognitionResult &result) {
+  return result.GetDocumentType().compare(0, 4, "mrz.") == 0;
+}
+
+// returns false if some of the present key fields is not accepted yet
+bool MakeMrzKey(const se::smartid::RecognitionResult &result, std::string &key) {
+  if (!IsMrzResult(result) || !result.HasStringField("number")) {
+    return false;
+  }
+  
+  key = result.GetDocumentType();
+  for (const char *fieldName : kMrzKeyFields) {
+    if (!result.HasStringField(fieldName)) {
+      continue;
+    }
+    const se::smartid::StringField &field = result.GetStringField(fieldName);
+    if (!field.IsAccepted()) {
+      return false;
+    }
+    key += '|';
+    key += field.GetUtf8Value();
+  }
+  return true;
+}
+
+bool AllStringFieldsAccepted(const se::smartid::RecognitionResult &result) {
+  for (const auto &field : result.GetStringFields()) {
+    if (!field.second.IsAccepted()) {
+      return false;
+    }
+  }
+  return !result.GetStringFields().empty();
+}
+
+struct CachedResult {
+  std::string key;
+  se::smartid::RecognitionResult result;
+};
+
+} // namespace
+
+@interface SESIDMrzResultCache() {
+  std::mutex mutex_;
+  std::list<CachedResult> results_; // most recently used first
+  std::unordered_map<std::string, std::list<CachedResult>::iterator> index_;
+}
+
+@property (atomic, readwrite) NSUInteger hitsCount;
+@property (atomic, readwrite) NSUInteger missesCount;
+
+@end
+
+@implementation SESIDMrzResultCache
+
+- (id) init {
+  if (self = [super init]) {
+    self.capacity = 64;
+  }
+  return self;
+}
+
+- (void) storeResult:(const se::smartid::RecognitionResult &)result {
+  std::string key;
+  if (!AllStringFieldsAccepted(result) || !MakeMrzKey(result, key)) {
+    return;
+  }
+  
+  // personal images (photo, signature) are not kept beyond the session
+  CachedResult cached = {key, result};
+  cached.result.GetImageFields().clear();
+  cached.result.SetIsTerminal(true);
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->result = cached.result;
+    results_.splice(results_.begin(), results_, it->second);
+    return;
+  }
+  
+  results_.push_front(cached);
+  index_[key] = results_.begin();
+  while (results_.size() > self.capacity && !results_.empty()) {
+    index_.erase(results_.back().key);
+    results_.pop_back();
+  }
+}
+
+- (BOOL) findValidatedResult:(se::smartid::RecognitionResult &)validatedResult
+                   forResult:(const se::smartid::RecognitionResult &)result {
+  std::string key;
+  if (!MakeMrzKey(result, key)) {
+    return NO;
+  }
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = index_.find(key);
+  if (it == index_.end()) {
+    ++self.missesCount;
+    return NO;
+  }
+  
+  results_.splice(results_.begin(), results_, it->second);
+  validatedResult = it->second->result;
+  // keeping the most fresh geometry for visualization
+  validatedResult.SetMatchResults(result.GetMatchResults());
+  validatedResult.SetSegmentationResults(result.GetSegmentationResults());
+  ++self.hitsCount;
+  return YES;
+}
+
+- (double) hitRate {
+  const NSUInteger lookups = self.hitsCount + self.missesCount;
+  return lookups == 0 ? 0.0 : (double)self.hitsCount / lookups;
+}
+
+- (void) removeAllResults {
+  std::lock_guard<std::mutex> lock(mutex_);
+  results_.clear();
+  index_.clear();
+}
+
+@end
@@ -0,0 +1,126 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <smartIdEngine/smartid_engine.h>
+
+#include "SESIDSessionHandle.h"
+
+/*****************************************************************************
+ SESIDMultiPageSession recognizes multi-side (multi-page) documents such as
+ rus.sts.new / rus.sts.old front and back. Each side has its own
+ se::smartid::RecognitionSession, sides are processed concurrently and side
+ results are merged into a single se::smartid::RecognitionResult.
+ 
+ Fields present on several sides are cross-checked: the most confident
+ value is kept and the field is reported as inconsistent if values differ.
+ 
+ Results don't depend on concurrency or scheduling: hinted frames of a side
+ are processed sequentially in input order and frames without hint after
+ them, side results are merged in side order and ties in confidence are
+ resolved in favour of the lower side.
+*****************************************************************************/
+
+class SESIDMultiPageSession {
+public:
+  /// Side hint for frames with unknown side
+  static const int kAutoSide = -1;
+
+  /// Input frame for one of the sides
+  struct SideFrame {
+    SideFrame(const se::smartid::Image &image, int side = kAutoSide,
+              se::smartid::ImageOrientation orientation = se::smartid::Landscape);
+
+    se::smartid::Image image;
+    int side; ///< side index or kAutoSide
+    se::smartid::ImageOrientation orientation;
+  };
+
+  /**
+   * @brief Main ctor, takes ownership of the sessions
+   * @param side_sessions - session for each side of the document
+   *
+   * @throws std::invalid_argument if there are no sessions
+   */
+  explicit SESIDMultiPageSession(std::vector<SESIDSessionHandle> side_sessions);
+
+  /**
+   * @brief Processes frames concurrently. Frame with side hint is processed
+   *        by the session of that side. Frames without hint are processed after
+   *        hinted ones, in input order, each by the first side which has no
+   *        terminal result yet; side can't be detected since sides usually share
+   *        document type (rus.sts.new covers front and back), so frames of other
+   *        sides need an explicit hint
+   * @return merged result of all sides
+   *
+   * @throws std::invalid_argument if side hint is out of range
+   */
+  se::smartid::RecognitionResult ProcessFrames(const std::vector<SideFrame> &frames);
+
+  /// Merged result of all sides
+  se::smartid::RecognitionResult GetMergedResult() const;
+
+  /// Latest result of the side
+  se::smartid::RecognitionResult GetSideResult(int side) const;
+
+  /// Names of fields which have different values on different sides
+  std::vector<std::string> GetInconsistentFields() const;
+
+  int GetSidesCount() const;
+
+  /// Maximum number of sides processed at once, 0 means all sides (default),
+  /// 1 processes sides sequentially on the calling thread
+  void SetConcurrency(int concurrency);
+  int GetConcurrency() const;
+
+  /// Resets all side sessions and results
+  void Reset();
+
+private:
+  struct Task {
+    int side;
+    const SideFrame *frame;
+  };
+
+  void ProcessTask(const Task &task);
+  bool IsSideTerminal(int side) const;
+
+private:
+  SESIDMultiPageSession(const SESIDMultiPageSession &);
+  void operator=(const SESIDMultiPageSession &);
+
+  std::vector<SESIDSessionHandle> sessions_;
+  std::vector<se::smartid::RecognitionResult> side_results_;
+  mutable std::mutex mutex_; ///< guards side_results_
+  std::atomic<int> concurrency_;
+};
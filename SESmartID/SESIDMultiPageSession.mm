@@ -0,0 +1,233 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDMultiPageSession.h"
+
+#import <Foundation/Foundation.h>
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// keeps the most confident version of each field, collecting names
+// of fields whose values differ between sides
+void MergeStringFields(const std::map<std::string, se::smartid::StringField> &fields,
+                       std::map<std::string, se::smartid::StringField> &merged,
+                       std::set<std::string> &inconsistent) {
+  for (const auto &field : fields) {
+    const auto it = merged.find(field.first);
+    if (it == merged.end()) {
+      merged.insert(field);
+      continue;
+    }
+    if (it->second.GetUtf8Value() != field.second.GetUtf8Value()) {
+      inconsistent.insert(field.first);
+    }
+    if (field.second.GetConfidence() > it->second.GetConfidence()) {
+      it->second = field.second;
+    }
+  }
+}
+
+void MergeImageFields(const std::map<std::string, se::smartid::ImageField> &fields,
+                      std::map<std::string, se::smartid::ImageField> &merged) {
+  for (const auto &field : fields) {
+    const auto it = merged.find(field.first);
+    if (it == merged.end()) {
+      merged.insert(field);
+    } else if (field.second.GetConfidence() > it->second.GetConfidence()) {
+      it->second = field.second;
+    }
+  }
+}
+
+se::smartid::RecognitionResult MergeResults(
+    const std::vector<se::smartid::RecognitionResult> &results,
+    std::set<std::string> &inconsistent) {
+  std::map<std::string, se::smartid::StringField> stringFields;
+  std::map<std::string, se::smartid::ImageField> imageFields;
+  std::string documentType;
+  std::vector<se::smartid::MatchResult> matchResults;
+  std::vector<se::smartid::SegmentationResult> segmentationResults;
+  bool isTerminal = !results.empty();
+  
+  for (size_t i = 0; i < results.size(); ++i) {
+    const se::smartid::RecognitionResult &result = results[i];
+    MergeStringFields(result.GetStringFields(), stringFields, inconsistent);
+    MergeImageFields(result.GetImageFields(), imageFields);
+    if (documentType.empty()) {
+      documentType = result.GetDocumentType();
+    }
+    matchResults.insert(matchResults.end(), result.GetMatchResults().begin(),
+                        result.GetMatchResults().end());
+    segmentationResults.insert(segmentationResults.end(),
+                               result.GetSegmentationResults().begin(),
+                               result.GetSegmentationResults().end());
+    isTerminal = isTerminal && result.IsTerminal();
+  }
+  
+  return se::smartid::RecognitionResult(stringFields, imageFields, documentType,
+                                        matchResults, segmentationResults, isTerminal);
+}
+
+} // namespace
+
+SESIDMultiPageSession::SideFrame::SideFrame(const se::smartid::Image &image, int side,
+                                            se::smartid::ImageOrientation orientation)
+  : image(image),
+    side(side),
+    orientation(orientation) {}
+
+SESIDMultiPageSession::SESIDMultiPageSession(std::vector<SESIDSessionHandle> side_sessions)
+  : sessions_(std::move(side_sessions)),
+    concurrency_(0) {
+  if (sessions_.empty()) {
+    throw std::invalid_argument("Multi-page session requires at least one side session");
+  }
+  side_results_.resize(sessions_.size());
+}
+
+se::smartid::RecognitionResult SESIDMultiPageSession::ProcessFrames(
+    const std::vector<SideFrame> &frames) {
+  std::vector<Task> tasks;
+  std::vector<const SideFrame *> autoFrames;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const int side = frames[i].side;
+    if (side == kAutoSide) {
+      autoFrames.push_back(&frames[i]);
+    } else if (side >= 0 && side < GetSidesCount()) {
+      Task task = {side, &frames[i]};
+      tasks.push_back(task);
+    } else {
+      throw std::invalid_argument("Side hint is out of range");
+    }
+  }
+  
+  // one session can't process two frames at once, so tasks of the same side
+  // are processed sequentially and different sides concurrently
+  std::vector<std::vector<Task> > sideTasks(sessions_.size());
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    sideTasks[tasks[i].side].push_back(tasks[i]);
+  }
+  // sides are statically assigned to lanes, so with limited concurrency
+  // the same side is always processed by the same lane
+  const size_t sidesCount = sideTasks.size();
+  const int concurrency = concurrency_;
+  const size_t lanesCount = concurrency > 0 ? std::min<size_t>(concurrency, sidesCount) : sidesCount;
+  // dispatch_apply is synchronous, so capturing a pointer instead of copying tasks
+  const std::vector<std::vector<Task> > *sideTasksPtr = &sideTasks;
+  void (^processLane)(size_t) = ^(size_t lane) {
+    for (size_t side = lane; side < sidesCount; side += lanesCount) {
+      const std::vector<Task> &tasksOfSide = (*sideTasksPtr)[side];
+      for (size_t i = 0; i < tasksOfSide.size(); ++i) {
+        ProcessTask(tasksOfSide[i]);
+      }
+    }
+  };
+  if (lanesCount == 1) {
+    processLane(0);
+  } else {
+    dispatch_apply(lanesCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0),
+                   processLane);
+  }
+  
+  // sides of one document usually share the document type (e.g. rus.sts.new is both
+  // front and back), so side can't be told by matching; frames without hint go to
+  // the first side which has no terminal result yet
+  for (size_t i = 0; i < autoFrames.size(); ++i) {
+    for (int side = 0; side < GetSidesCount(); ++side) {
+      if (!IsSideTerminal(side)) {
+        const Task task = {side, autoFrames[i]};
+        ProcessTask(task);
+        break;
+      }
+    }
+  }
+  
+  return GetMergedResult();
+}
+
+void SESIDMultiPageSession::ProcessTask(const Task &task) {
+  try {
+    const se::smartid::RecognitionResult result =
+      sessions_[task.side]->ProcessImage(task.frame->image, task.frame->orientation);
+    std::lock_guard<std::mutex> lock(mutex_);
+    side_results_[task.side] = result;
+  } catch (const std::exception &e) {
+    NSLog(@"Exception thrown during side %d processing: %s", task.side, e.what());
+  }
+}
+
+bool SESIDMultiPageSession::IsSideTerminal(int side) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return side_results_[side].IsTerminal();
+}
+
+se::smartid::RecognitionResult SESIDMultiPageSession::GetMergedResult() const {
+  std::set<std::string> inconsistent;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return MergeResults(side_results_, inconsistent);
+}
+
+se::smartid::RecognitionResult SESIDMultiPageSession::GetSideResult(int side) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (side < 0 || side >= GetSidesCount()) {
+    throw std::invalid_argument("Side index is out of range");
+  }
+  return side_results_[side];
+}
+
+std::vector<std::string> SESIDMultiPageSession::GetInconsistentFields() const {
+  std::set<std::string> inconsistent;
+  std::lock_guard<std::mutex> lock(mutex_);
+  MergeResults(side_results_, inconsistent);
+  return std::vector<std::string>(inconsistent.begin(), inconsistent.end());
+}
+
+int SESIDMultiPageSession::GetSidesCount() const {
+  return static_cast<int>(sessions_.size());
+}
+
+void SESIDMultiPageSession::SetConcurrency(int concurrency) {
+  concurrency_ = std::max(concurrency, 0);
+}
+
+int SESIDMultiPageSession::GetConcurrency() const {
+  return concurrency_;
+}
+
+void SESIDMultiPageSession::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < sessions_.size(); ++i) {
+    sessions_[i]->Reset();
+    side_results_[i] = se::smartid::RecognitionResult();
+  }
+}
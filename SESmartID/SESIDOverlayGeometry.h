@@ -0,0 +1,105 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <smartIdEngine/smartid_result.h>
+
+/*****************************************************************************
+ SESIDOverlayGeometry is a compact plain-old-data view of match and
+ segmentation results of a single frame, sufficient for drawing overlays:
+ a contiguous array of quadrangles with small integer zone ids and
+ acceptance flags and a document type id. It contains no strings or
+ containers, so it can be copied with memcpy and passed between threads
+ without allocations.
+ 
+ SESIDOverlayGeometryBuilder fills it from reporter callbacks, which are
+ called before any OCR of the frame starts, and maps ids back to names.
+*****************************************************************************/
+
+struct SESIDGeometryQuadrangle {
+  static const int16_t kDocumentZoneId = -1;
+
+  float points[8];  ///< x and y of the four vertices in input image pixels
+  int16_t zone_id;  ///< kDocumentZoneId for document quadrangle
+  uint8_t accepted; ///< whether quadrangle is ready to be visualized
+  uint8_t reserved;
+};
+
+struct SESIDOverlayGeometry {
+  static const int kMaxQuadrangles = 64;
+
+  SESIDGeometryQuadrangle quadrangles[kMaxQuadrangles];
+  int quadrangles_count;
+  int document_type_id; ///< -1 if the frame was not matched
+  uint64_t frame_id;
+};
+
+class SESIDOverlayGeometryBuilder {
+public:
+  SESIDOverlayGeometryBuilder();
+
+  /// Starts geometry of a new frame
+  void Reset(uint64_t frame_id);
+
+  /// Appends document quadrangles, sets document type of the first result
+  void AddMatchResults(const std::vector<se::smartid::MatchResult> &match_results);
+
+  /// Appends zones quadrangles, quadrangles over the capacity are dropped
+  void AddSegmentationResults(
+      const std::vector<se::smartid::SegmentationResult> &segmentation_results);
+
+  const SESIDOverlayGeometry& GetGeometry() const;
+
+  /// Names for ids, empty if id is unknown, can be called from any thread
+  std::string GetDocumentTypeName(int document_type_id) const;
+  std::string GetZoneName(int zone_id) const;
+
+private:
+  SESIDOverlayGeometryBuilder(const SESIDOverlayGeometryBuilder &);
+  void operator=(const SESIDOverlayGeometryBuilder &);
+
+  struct NameTable {
+    std::map<std::string, int> ids;
+    std::vector<std::string> names;
+  };
+
+  int Intern(NameTable &table, const std::string &name);
+  std::string Lookup(const NameTable &table, int id) const;
+  void Append(const se::smartid::Quadrangle &quadrangle, int zone_id, bool accepted);
+
+  SESIDOverlayGeometry geometry_;
+
+  mutable std::mutex names_mutex_; ///< tables only grow, lookups of known names are fast
+  NameTable document_types_;
+  NameTable zones_;
+};
@@ -0,0 +1,106 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDOverlayGeometry.h"
+
+SESIDOverlayGeometryBuilder::SESIDOverlayGeometryBuilder() {
+  Reset(0);
+}
+
+void SESIDOverlayGeometryBuilder::Reset(uint64_t frame_id) {
+  geometry_.quadrangles_count = 0;
+  geometry_.document_type_id = -1;
+  geometry_.frame_id = frame_id;
+}
+
+void SESIDOverlayGeometryBuilder::AddMatchResults(
+    const std::vector<se::smartid::MatchResult> &match_results) {
+  for (const se::smartid::MatchResult &result : match_results) {
+    if (geometry_.document_type_id < 0) {
+      geometry_.document_type_id = Intern(document_types_, result.GetTemplateType());
+    }
+    Append(result.GetQuadrangle(), SESIDGeometryQuadrangle::kDocumentZoneId,
+           result.GetAccepted());
+  }
+}
+
+void SESIDOverlayGeometryBuilder::AddSegmentationResults(
+    const std::vector<se::smartid::SegmentationResult> &segmentation_results) {
+  for (const se::smartid::SegmentationResult &result : segmentation_results) {
+    for (const auto &zone_quad : result.GetZoneQuadrangles()) {
+      Append(zone_quad.second, Intern(zones_, zone_quad.first), result.GetAccepted());
+    }
+  }
+}
+
+const SESIDOverlayGeometry& SESIDOverlayGeometryBuilder::GetGeometry() const {
+  return geometry_;
+}
+
+std::string SESIDOverlayGeometryBuilder::GetDocumentTypeName(int document_type_id) const {
+  return Lookup(document_types_, document_type_id);
+}
+
+std::string SESIDOverlayGeometryBuilder::GetZoneName(int zone_id) const {
+  return Lookup(zones_, zone_id);
+}
+
+int SESIDOverlayGeometryBuilder::Intern(NameTable &table, const std::string &name) {
+  std::lock_guard<std::mutex> lock(names_mutex_);
+  const auto it = table.ids.find(name);
+  if (it != table.ids.end()) {
+    return it->second;
+  }
+  const int id = static_cast<int>(table.names.size());
+  table.ids[name] = id;
+  table.names.push_back(name);
+  return id;
+}
+
+std::string SESIDOverlayGeometryBuilder::Lookup(const NameTable &table, int id) const {
+  std::lock_guard<std::mutex> lock(names_mutex_);
+  if (id < 0 || id >= static_cast<int>(table.names.size())) {
+    return std::string();
+  }
+  return table.names[id];
+}
+
+void SESIDOverlayGeometryBuilder::Append(const se::smartid::Quadrangle &quadrangle,
+                                         int zone_id, bool accepted) {
+  if (geometry_.quadrangles_count >= SESIDOverlayGeometry::kMaxQuadrangles) {
+    return;
+  }
+  SESIDGeometryQuadrangle &target = geometry_.quadrangles[geometry_.quadrangles_count++];
+  for (int i = 0; i < 4; ++i) {
+    target.points[2 * i] = static_cast<float>(quadrangle[i].x);
+    target.points[2 * i + 1] = static_cast<float>(quadrangle[i].y);
+  }
+  target.zone_id = static_cast<int16_t>(zone_id);
+  target.accepted = accepted ? 1 : 0;
+  target.reserved = 0;
+}
@@ -30,19 +30,168 @@
 
 #include <smartIdEngine/smartid_engine.h>
 
+#import "SESIDImageFileCache.h"
+#import "SESIDMrzResultCache.h"
+
+#include "SESIDImageFieldStore.h"
+#include "SESIDSessionHandle.h"
+
 @interface SESIDRecognitionCore : NSObject
 
-@property (atomic, assign) BOOL canProcessFrames;
+@property (atomic, assign) BOOL canProcessFrames; // cancellation token, checked before and after processing
+
+// time budget for a single frame in seconds, 0 means no budget (default)
+// frame processing can't be interrupted, so after a frame exceeds the budget
+// following frames are skipped for the overrun time
+@property (atomic, assign) NSTimeInterval frameTimeBudget;
+@property (atomic, readonly) NSTimeInterval lastFrameProcessingTime;
+
+@property (nonatomic, assign) size_t memoryBudget; // soft budget in bytes, 0 means no budget
+
+@property (nonatomic) SESIDImageFileCache *imageFileCache; // decoded images for processImageFile:
+
+// output size option: maximum number of OcrCharVariant alternatives kept for each character
+// of string fields in processed results, 0 means all (default); the engine still computes
+// all alternatives, they are trimmed after processing
+// fields with a raw value are not trimmed, so that the raw value is preserved
+// trimming makes results smaller for the delegate, it doesn't make processing cheaper:
+// fields exceeding the limit are rebuilt on every frame, which copies their characters
+// and the kept variants
+@property (atomic, assign) NSUInteger maxOcrCharVariants;
+
+// whether image fields are kept in non-terminal results, YES by default
+// if NO, image fields are only collected into the session image field store
+// and terminal results get the best stored version of each field
+@property (atomic, assign) BOOL deliversIntermediateImageFields;
+
+// whether image fields are collected into the session image field store when
+// deliversIntermediateImageFields is YES (with NO they always are), NO by default
+// collecting rates sharpness of every image field on every frame
+@property (atomic, assign) BOOL collectsBestImageFields;
+
+// if NO, sessions spawned afterwards are created with field and template image extraction
+// options (e.g. passport.extractFieldImages) disabled, so the engine doesn't crop images,
+// e.g. when field masks keep string fields only; YES by default
+@property (atomic, assign) BOOL extractsImageFields;
+
+// validated MRZ results reused across frames and sessions, can be shared between cores
+// nil by default (disabled); when set, string fields of read documents are kept in memory
+// after the session ends and reading the same MRZ again completes with the cached fields
+@property (atomic) SESIDMrzResultCache *mrzResultCache;
+
+// if YES, after a document is matched the next video frame is processed only within
+// the document bounding rectangle expanded by autoRoiMargin (fraction of its size, 0.15
+// by default); whole ROI is processed again as soon as the document is lost, NO by default
+@property (atomic, assign) BOOL autoRoiEnabled;
+@property (atomic, assign) double autoRoiMargin;
+@property (atomic, readonly) double lastProcessedRoiFraction; // processed share of the last frame
+
+// records timed events of processing stages (ingest, process, match and segmentation
+// callbacks, postprocess, delivery) of all cores, NO by default, see SESIDTracer
+@property (nonatomic) BOOL tracingEnabled;
 
 - (id) init;
 
+// settings of new sessions; the reference is valid until the next engine reload and
+// must be used on the main queue only, changes made through it are not synchronized with
+// snapshot recognition, spawning and warm-up on other threads, so prefer the methods below
 - (se::smartid::SessionSettings &) sessionSettings;
 
+// thread-safe access to settings of new sessions, wildcard expressions can be used in masks
+- (void) addEnabledDocumentTypesMask:(const std::string &)documentTypesMask;
+- (void) removeEnabledDocumentTypesMask:(const std::string &)documentTypesMask;
+- (void) setEnabledDocumentTypes:(const std::vector<std::string> &)documentTypes;
+- (std::vector<std::string>) enabledDocumentTypes;
+- (std::vector<std::vector<std::string> >) supportedDocumentTypes;
+- (void) setSessionOption:(const std::string &)name value:(const std::string &)value;
+- (std::string) sessionOption:(const std::string &)name; // empty if option is not set
+
 - (void) initializeSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter;
 
+// best version of the image field collected during current session, null if none
+// fields are collected only if deliversIntermediateImageFields is NO or collectsBestImageFields is YES
+- (SESIDImageFieldStore::ImageFieldHandle) bestImageFieldWithName:(const std::string &)name;
+
+// id of the frame being processed (or of the last processed one), incremented for
+// every frame passed to a session, e.g. to tell reporter callbacks of different frames apart
+- (uint64_t) currentFrameId;
+
+// stops processing: frames are not accepted and result of the frame in flight is abandoned
+- (void) cancelProcessing;
+
+// runs synthetic frames through sessions for document types matching the mask in background
+// so that models and lazily built tables are loaded before the first real frame
+// completion is called on the main queue with warm-up duration
+- (void) warmUpDocumentTypesMask:(const std::string &)documentTypesMask
+                      completion:(void (^)(BOOL succeeded, NSTimeInterval duration))completion;
+
+// writes recorded trace events as Chrome trace-event JSON (chrome://tracing, Perfetto)
+- (BOOL) exportTraceToFile:(NSString *)path;
+- (void) clearTrace;
+
+// loads new configuration bundle in background and switches new sessions to it
+// on the main queue, current sessions keep working with the previous engine which is
+// destroyed together with them; enabled document types and options are carried over
+// to new settings object, snapshot sessions of the previous engine are released
+// completion is called on the main queue with load duration and memory overlap in bytes
+- (void) reloadEngineWithConfigPath:(NSString *)configPath
+                         completion:(void (^)(BOOL succeeded, NSTimeInterval duration,
+                                              size_t memoryOverlap))completion;
+
+// spawns an additional session with current settings, e.g. for SESIDStreamScheduler
+// the handle owns the session and keeps the engine which spawned it alive until
+// the session is destroyed, even after engine reload
+- (SESIDSessionHandle) spawnSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter;
+
+// same with enabled document types narrowed to the mask (e.g. "rus.sts.*", "mrz.mrp"),
+// raises SmartIDException if no enabled document type matches the mask
+- (SESIDSessionHandle) spawnSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter
+                              documentTypesMask:(const std::string &)documentTypesMask;
+
+// destroys current session with its integration state, frames can't be processed until
+// next initializeSessionWithReporter: call
+- (void) releaseSession;
+
+// physical memory footprint of the process (engine, sessions and results), in bytes
+- (size_t) memoryFootprint;
+- (BOOL) isMemoryBudgetExceeded;
+
+// drops decoded images of imageFileCache, called by SESIDViewController on memory warning
+// and when memoryBudget is exceeded; file processing methods call it themselves after
+// loading an image with the budget exceeded
+- (void) releaseCachedMemory;
+
+// field masks applied to every result returned by the processing methods
+// wildcard expressions can be used, e.g. "full_mrz", "mrz_*", "*"
+// with no included masks all fields are kept, masks can be changed from any thread
+- (void) addIncludedFieldsMask:(const std::string &)fieldsMask;
+- (void) addExcludedFieldsMask:(const std::string &)fieldsMask;
+- (void) resetFieldsMasks;
+- (BOOL) isFieldEnabled:(const std::string &)fieldName;
+
+// catalog of fields and zones produced for each document type, collected from
+// processed results during the core lifetime (across sessions), thread-safe
+// masks added with addIncludedFieldsMask: and addExcludedFieldsMask: are checked against
+// the catalog and a warning is logged if a mask matches no cataloged field
+- (std::vector<std::string>) catalogedDocumentTypes;
+- (std::vector<std::string>) catalogedStringFieldNamesForDocumentType:(const std::string &)documentType;
+- (std::vector<std::string>) catalogedImageFieldNamesForDocumentType:(const std::string &)documentType;
+- (std::map<std::string, std::string>) catalogedZoneFieldNamesForDocumentType:(const std::string &)documentType;
+
+// whether fields mask matches at least one cataloged field of the document type
+- (BOOL) fieldsMask:(const std::string &)fieldsMask
+    matchesCatalogForDocumentType:(const std::string &)documentType;
+
 - (se::smartid::RecognitionResult) processSampleBuffer:(CMSampleBufferRef)sampleBuffer
                                            orientation:(se::smartid::ImageOrientation)orientation;
 
+// processed is set to NO if the frame wasn't processed and the returned result is empty:
+// skipped because of frameTimeBudget, cancelled, no session or processing error
+// such results must not be delivered as recognition results
+- (se::smartid::RecognitionResult) processSampleBuffer:(CMSampleBufferRef)sampleBuffer
+                                           orientation:(se::smartid::ImageOrientation)orientation
+                                             processed:(BOOL *)processed;
+
 - (se::smartid::RecognitionResult) processUncompressedImageData:(uint8_t *)imageData
                                                           width:(int)width
                                                          height:(int)height
@@ -50,6 +199,41 @@
                                                        channels:(int)channels
                                                     orientation:(se::smartid::ImageOrientation)orientation;
 
+// processes only the rectangle of interest given in input image coordinates, pixels outside
+// of it are not read by any processing stage (conversion, rotation, matching, OCR)
+// result coordinates are the same as for the full frame, processed can be NULL
+- (se::smartid::RecognitionResult) processUncompressedImageData:(uint8_t *)imageData
+                                                          width:(int)width
+                                                         height:(int)height
+                                                         stride:(int)stride
+                                                       channels:(int)channels
+                                                            roi:(const se::smartid::Rectangle &)roi
+                                                    orientation:(se::smartid::ImageOrientation)orientation
+                                                      processed:(BOOL *)processed;
+
+// single-shot recognition of a still image (e.g. scan) in a dedicated session which is
+// reset before each image, independent from the video session; current session settings
+// are used, with one session per internal engine if enabled types span several of them
+// image is downscaled so that its larger side doesn't exceed maxDimension (0 means no limit)
+// returned result is final (terminal)
+- (se::smartid::RecognitionResult) recognizeSnapshotImage:(const se::smartid::Image &)image
+                                              maxDimension:(int)maxDimension
+                                               orientation:(se::smartid::ImageOrientation)orientation;
+
+// same as above, image file is decoded through imageFileCache at reduced resolution
+- (se::smartid::RecognitionResult) recognizeSnapshotFile:(NSString *)imageFile
+                                             maxDimension:(int)maxDimension
+                                              orientation:(se::smartid::ImageOrientation)orientation;
+
+// image file is decoded through imageFileCache, maxDimension limits the larger
+// side of the decoded image (0 means full resolution)
+- (se::smartid::RecognitionResult) processImageFile:(NSString *)imageFile
+                                       maxDimension:(int)maxDimension
+                                        orientation:(se::smartid::ImageOrientation)orientation;
+
 + (UIImage *) uiImageFromSmartIdImage:(const se::smartid::Image &)image;
 
+// approximate memory held by result fields, in bytes
++ (size_t) memoryUsageOfResult:(const se::smartid::RecognitionResult &)result;
+
 @end
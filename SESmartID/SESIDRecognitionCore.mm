@@ -28,16 +28,240 @@
 
 #import "SESIDRecognitionCore.h"
 
+#include "SESIDTracer.h"
+
 #import <UIKit/UIImage.h>
 
+#include <mach/mach.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+
+namespace {
+
+// matches name against wildcard expression where '*' stands for any sequence
+bool MatchesWildcard(const std::string &name, const std::string &mask) {
+  size_t n = 0, m = 0;
+  size_t starPos = std::string::npos, matchPos = 0;
+  while (n < name.size()) {
+    if (m < mask.size() && mask[m] == '*') {
+      starPos = m++;
+      matchPos = n;
+    } else if (m < mask.size() && mask[m] == name[n]) {
+      ++m;
+      ++n;
+    } else if (starPos != std::string::npos) {
+      m = starPos + 1;
+      n = ++matchPos;
+    } else {
+      return false;
+    }
+  }
+  while (m < mask.size() && mask[m] == '*') {
+    ++m;
+  }
+  return m == mask.size();
+}
+
+bool MatchesAnyWildcard(const std::string &name, const std::vector<std::string> &masks) {
+  for (size_t i = 0; i < masks.size(); ++i) {
+    if (MatchesWildcard(name, masks[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// consecutive frames without a match after which a locked session is unlocked
+// and frames are routed between sessions again
+const size_t kRoutingUnlockFramesCount = 5;
+
+// field masks, replaced as a whole when changed so that processing threads
+// keep using the snapshot they took
+struct FieldsMasks {
+  std::vector<std::string> included;
+  std::vector<std::string> excluded;
+  
+  bool IsEmpty() const {
+    return included.empty() && excluded.empty();
+  }
+  
+  bool IsFieldEnabled(const std::string &name) const {
+    if (!included.empty() && !MatchesAnyWildcard(name, included)) {
+      return false;
+    }
+    return !MatchesAnyWildcard(name, excluded);
+  }
+};
+
+// whether option controls cropping of field or template images (e.g. passport.extractFieldImages)
+bool IsImageExtractionOption(const std::string &name) {
+  static const std::string suffixes[] = {".extractFieldImages", ".extractTemplateImages"};
+  for (const std::string &suffix : suffixes) {
+    if (name.size() >= suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// names of fields and zones observed in results of a single document type
+struct FieldCatalogEntry {
+  std::set<std::string> stringFieldNames;
+  std::set<std::string> imageFieldNames;
+  std::map<std::string, std::string> zoneFieldNames; // [zone name, field name]
+};
+
+// splits enabled document types into groups belonging to single internal engines
+std::vector<std::vector<std::string> > EnabledDocumentTypesByEngine(
+    const se::smartid::SessionSettings &settings) {
+  const std::vector<std::string> &enabled = settings.GetEnabledDocumentTypes();
+  const std::vector<std::vector<std::string> > &supported = settings.GetSupportedDocumentTypes();
+  
+  std::vector<std::vector<std::string> > groups;
+  for (size_t i = 0; i < supported.size(); ++i) {
+    std::vector<std::string> group;
+    for (size_t j = 0; j < enabled.size(); ++j) {
+      if (std::find(supported[i].begin(), supported[i].end(), enabled[j]) != supported[i].end()) {
+        group.push_back(enabled[j]);
+      }
+    }
+    if (!group.empty()) {
+      groups.push_back(group);
+    }
+  }
+  return groups;
+}
+
+se::smartid::Rectangle IntersectRectangles(const se::smartid::Rectangle &a,
+                                           const se::smartid::Rectangle &b) {
+  const int left = std::max(a.x, b.x);
+  const int top = std::max(a.y, b.y);
+  const int right = std::min(a.x + a.width, b.x + b.width);
+  const int bottom = std::min(a.y + a.height, b.y + b.height);
+  if (right <= left || bottom <= top) {
+    return se::smartid::Rectangle();
+  }
+  return se::smartid::Rectangle(left, top, right - left, bottom - top);
+}
+
+// maps point of the frame rotated to landscape (coordinates of match results)
+// back to the input frame of given size
+se::smartid::Point InputFramePoint(const se::smartid::Point &point, int width, int height,
+                                   se::smartid::ImageOrientation orientation) {
+  switch (orientation) {
+    case se::smartid::Portrait: // rotated 90 degrees clockwise
+      return se::smartid::Point(point.y, height - point.x);
+    case se::smartid::InvertedLandscape:
+      return se::smartid::Point(width - point.x, height - point.y);
+    case se::smartid::InvertedPortrait: // rotated 90 degrees counter-clockwise
+      return se::smartid::Point(width - point.y, point.x);
+    default:
+      return point;
+  }
+}
+
+// bounding rectangle of matched document quadrangles in input frame coordinates
+// expanded by margin (fraction of its size) on each side, false if nothing is matched
+bool DocumentRoi(const se::smartid::RecognitionResult &result,
+                 int width, int height, se::smartid::ImageOrientation orientation,
+                 double margin, se::smartid::Rectangle &roi) {
+  const std::vector<se::smartid::MatchResult> &matchResults = result.GetMatchResults();
+  if (matchResults.empty()) {
+    return false;
+  }
+  
+  double minX = width, minY = height, maxX = 0, maxY = 0;
+  for (const se::smartid::MatchResult &matchResult : matchResults) {
+    const se::smartid::Quadrangle &quadrangle = matchResult.GetQuadrangle();
+    for (int i = 0; i < 4; ++i) {
+      const se::smartid::Point point = InputFramePoint(quadrangle[i], width, height, orientation);
+      minX = std::min(minX, point.x);
+      minY = std::min(minY, point.y);
+      maxX = std::max(maxX, point.x);
+      maxY = std::max(maxY, point.y);
+    }
+  }
+  
+  const double marginX = (maxX - minX) * margin;
+  const double marginY = (maxY - minY) * margin;
+  const int left = (int)std::floor(minX - marginX);
+  const int top = (int)std::floor(minY - marginY);
+  const int right = (int)std::ceil(maxX + marginX);
+  const int bottom = (int)std::ceil(maxY + marginY);
+  roi = IntersectRectangles(se::smartid::Rectangle(left, top, right - left, bottom - top),
+                            se::smartid::Rectangle(0, 0, width, height));
+  return roi.width > 0 && roi.height > 0;
+}
+
+} // namespace
 
 @interface SESIDRecognitionCore() {
+  // engine used for new sessions and its settings, both replaced by
+  // reloadEngineWithConfigPath:, accessed under the mutex from any thread
+  std::shared_ptr<se::smartid::RecognitionEngine> engine_;
   std::unique_ptr<se::smartid::SessionSettings> sessionSettings_;
-  std::unique_ptr<se::smartid::RecognitionEngine> engine_;
-  std::unique_ptr<se::smartid::RecognitionSession> session_;
+  std::mutex engineMutex_;
+  
+  // engine of current sessions, kept alive until they are destroyed (declared before
+  // sessions_ so that sessions are destroyed first)
+  std::shared_ptr<se::smartid::RecognitionEngine> sessionsEngine_;
+  
+  // one session per internal engine when enabled document types span several engines,
+  // frames are dispatched to a single session: in turn until some session matches
+  // a document, then only to that session until it stops matching
+  std::vector<std::unique_ptr<se::smartid::RecognitionSession> > sessions_;
+  size_t activeSessionIndex_;
+  bool activeSessionLocked_;
+  size_t framesWithoutMatchCount_;
+  
+  // held by the processing thread, release is deferred if session is busy
+  std::mutex sessionMutex_;
+  std::atomic<bool> sessionReleaseRequested_;
+  
+  // ids attached to trace events of processed frames, frame id is also
+  // used by reporters to tell frames apart
+  uint32_t traceSessionId_;
+  std::atomic<uint64_t> frameId_;
+  
+  // document area of the previous frame used as ROI of the next one in auto ROI mode,
+  // dropped when document is not matched
+  bool autoRoiTracked_;
+  se::smartid::Rectangle autoRoi_;
+  
+  // video frames are skipped until this moment (steady clock ticks) after a frame
+  // exceeded frameTimeBudget, checked before the session mutex is taken
+  std::atomic<std::chrono::steady_clock::rep> skipFramesUntil_;
+  
+  // set by the caller, read by processing threads
+  std::shared_ptr<const FieldsMasks> fieldsMasks_;
+  std::mutex fieldsMasksMutex_;
+  
+  // [document type, entry], updated by processing threads and read by the caller
+  std::map<std::string, FieldCatalogEntry> fieldCatalog_;
+  std::mutex fieldCatalogMutex_;
+  
+  SESIDImageFieldStore imageFieldStore_; // best image fields of the current session
+  
+  // sessions reused by single-shot recognition (one per internal engine), reset before
+  // each image and respawned when engine or spawn settings change
+  std::shared_ptr<se::smartid::RecognitionEngine> snapshotSessionEngine_;
+  std::unique_ptr<se::smartid::SessionSettings> snapshotSessionSettings_;
+  std::vector<std::unique_ptr<se::smartid::RecognitionSession> > snapshotSessions_;
+  std::mutex snapshotSessionMutex_;
 }
 
+@property (atomic, readwrite) NSTimeInterval lastFrameProcessingTime;
+@property (atomic, readwrite) double lastProcessedRoiFraction;
+
 @end
 
 @implementation SESIDRecognitionCore
@@ -45,6 +269,19 @@
 - (id) init {
   if (self = [super init]) {
     self.canProcessFrames = NO;
+    sessionReleaseRequested_ = false;
+    frameId_ = 0;
+    skipFramesUntil_ = 0;
+    fieldsMasks_ = std::make_shared<const FieldsMasks>();
+    activeSessionIndex_ = 0;
+    activeSessionLocked_ = false;
+    framesWithoutMatchCount_ = 0;
+    self.imageFileCache = [[SESIDImageFileCache alloc] init];
+    self.deliversIntermediateImageFields = YES;
+    self.collectsBestImageFields = NO;
+    self.extractsImageFields = YES;
+    self.autoRoiMargin = 0.15;
+    self.lastProcessedRoiFraction = 1.0;
     
     [self initRecognitionCore];
   }
@@ -56,7 +293,7 @@
   
   try {
     // creating recognition engine
-    engine_.reset(new se::smartid::RecognitionEngine(dataPath.UTF8String));
+    engine_ = std::make_shared<se::smartid::RecognitionEngine>(dataPath.UTF8String);
     
     // creating default session settings
     sessionSettings_.reset(engine_->CreateSessionSettings());
@@ -82,16 +319,107 @@
   }
 }
 
+- (SESIDSessionHandle) spawnSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter {
+  return [self spawnSessionWithReporter:resultReporter documentTypesMask:""];
+}
+
+- (SESIDSessionHandle) spawnSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter
+                              documentTypesMask:(const std::string &)documentTypesMask {
+  try {
+    std::unique_ptr<se::smartid::SessionSettings> settings;
+    std::shared_ptr<se::smartid::RecognitionEngine> engine = [self engineWithSpawnSettings:settings];
+    if (!documentTypesMask.empty()) {
+      // keeping only enabled types which conform to the mask
+      const std::vector<std::string> enabledTypes = settings->GetEnabledDocumentTypes();
+      std::vector<std::string> maskedTypes;
+      for (size_t i = 0; i < enabledTypes.size(); ++i) {
+        if (MatchesWildcard(enabledTypes[i], documentTypesMask)) {
+          maskedTypes.push_back(enabledTypes[i]);
+        }
+      }
+      if (maskedTypes.empty()) {
+        [NSException raise:@"SmartIDException"
+                    format:@"No enabled document types match mask %s", documentTypesMask.c_str()];
+      }
+      settings->SetEnabledDocumentTypes(maskedTypes);
+    }
+    return SESIDSessionHandle(
+      engine->SpawnSession(*settings, resultReporter),
+      [engine](se::smartid::RecognitionSession *session) {
+        delete session;
+      });
+  } catch (const std::exception &e) {
+    [NSException raise:@"SmartIDException"
+                format:@"Exception thrown during session spawn: %s", e.what()];
+  }
+  return SESIDSessionHandle();
+}
+
+- (std::shared_ptr<se::smartid::RecognitionEngine>) engineWithSpawnSettings:
+    (std::unique_ptr<se::smartid::SessionSettings> &)spawnSettings {
+  // taken together so that engine reload can't switch them in between
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  spawnSettings = [self spawnSettingsFromSettings:*sessionSettings_];
+  return engine_;
+}
+
+- (uint64_t) currentFrameId {
+  return frameId_;
+}
+
+- (void) cancelProcessing {
+  self.canProcessFrames = NO;
+}
+
+- (void) releaseSession {
+  self.canProcessFrames = NO;
+  
+  // not blocking here since reporter callbacks may wait for the main queue
+  std::unique_lock<std::mutex> lock(sessionMutex_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    sessions_.clear();
+    sessionsEngine_.reset();
+  } else {
+    sessionReleaseRequested_ = true;
+  }
+}
+
 - (void) initializeSessionWithReporter:(se::smartid::ResultReporterInterface *)resultReporter {
   try {
-    const std::vector<std::string> &documentTypes = sessionSettings_->GetEnabledDocumentTypes();
+    std::unique_ptr<se::smartid::SessionSettings> settings;
+    std::shared_ptr<se::smartid::RecognitionEngine> engine = [self engineWithSpawnSettings:settings];
+    
+    const std::vector<std::string> &documentTypes = settings->GetEnabledDocumentTypes();
     NSLog(@"Enabled document types for recognition session to be created:");
     for (size_t i = 0; i < documentTypes.size(); ++i) {
       NSLog(@"%s", documentTypes[i].c_str());
     }
     
-    // creating recognition session
-    session_.reset(engine_->SpawnSession(*sessionSettings_, resultReporter));
+    // creating recognition sessions, one for each internal engine
+    const std::vector<std::vector<std::string> > engineDocumentTypes =
+      EnabledDocumentTypesByEngine(*settings);
+    
+    std::lock_guard<std::mutex> lock(sessionMutex_);
+    sessionReleaseRequested_ = false;
+    sessions_.clear();
+    sessionsEngine_ = engine;
+    imageFieldStore_.Clear();
+    ++traceSessionId_;
+    autoRoiTracked_ = false;
+    activeSessionIndex_ = 0;
+    activeSessionLocked_ = false;
+    framesWithoutMatchCount_ = 0;
+    if (engineDocumentTypes.size() <= 1) {
+      sessions_.emplace_back(engine->SpawnSession(*settings, resultReporter));
+    } else {
+      NSLog(@"Enabled document types span %zu engines, routing frames between sessions",
+            engineDocumentTypes.size());
+      for (size_t i = 0; i < engineDocumentTypes.size(); ++i) {
+        std::unique_ptr<se::smartid::SessionSettings> engineSettings(settings->Clone());
+        engineSettings->SetEnabledDocumentTypes(engineDocumentTypes[i]);
+        sessions_.emplace_back(engine->SpawnSession(*engineSettings, resultReporter));
+      }
+    }
   } catch (const std::exception &e) {
     [NSException raise:@"SmartIDException"
                 format:@"Exception thrown during session spawn: %s", e.what()];
@@ -104,24 +432,548 @@
   return *sessionSettings_;
 }
 
-- (se::smartid::RecognitionResult) processSampleBuffer:(CMSampleBufferRef)sampleBuffer
-                                           orientation:(se::smartid::ImageOrientation)orientation {
-  // extracting image data from sample buffer
-  CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+- (void) addEnabledDocumentTypesMask:(const std::string &)documentTypesMask {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  sessionSettings_->AddEnabledDocumentTypes(documentTypesMask);
+}
+
+- (void) removeEnabledDocumentTypesMask:(const std::string &)documentTypesMask {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  sessionSettings_->RemoveEnabledDocumentTypes(documentTypesMask);
+}
+
+- (void) setEnabledDocumentTypes:(const std::vector<std::string> &)documentTypes {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  sessionSettings_->SetEnabledDocumentTypes(documentTypes);
+}
+
+- (std::vector<std::string>) enabledDocumentTypes {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  return sessionSettings_->GetEnabledDocumentTypes();
+}
+
+- (std::vector<std::vector<std::string> >) supportedDocumentTypes {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  return sessionSettings_->GetSupportedDocumentTypes();
+}
+
+- (void) setSessionOption:(const std::string &)name value:(const std::string &)value {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  sessionSettings_->SetOption(name, value);
+}
+
+- (std::string) sessionOption:(const std::string &)name {
+  std::lock_guard<std::mutex> lock(engineMutex_);
+  return sessionSettings_->HasOption(name) ? sessionSettings_->GetOption(name) : std::string();
+}
+
+#pragma mark - Warm-up
+- (void) warmUpDocumentTypesMask:(const std::string &)documentTypesMask
+                      completion:(void (^)(BOOL succeeded, NSTimeInterval duration))completion {
+  // engine, settings and mask are captured on the calling thread, the mask reference
+  // may be a temporary which doesn't outlive the call
+  const std::string mask(documentTypesMask);
+  std::shared_ptr<se::smartid::RecognitionEngine> engine;
+  std::shared_ptr<se::smartid::SessionSettings> settings;
+  try {
+    std::unique_ptr<se::smartid::SessionSettings> spawnSettings;
+    engine = [self engineWithSpawnSettings:spawnSettings];
+    settings = std::move(spawnSettings);
+    settings->RemoveEnabledDocumentTypes("*");
+    settings->AddEnabledDocumentTypes(mask);
+  } catch (const std::exception &e) {
+    NSLog(@"Exception thrown during warm-up settings creation: %s", e.what());
+    if (completion) {
+      completion(NO, 0);
+    }
+    return;
+  }
+  
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    BOOL succeeded = YES;
+    
+    // synthetic BGRA frame of camera size with a document-like bright rectangle
+    // so that processing goes beyond the first stages
+    const int width = 1280, height = 720, channels = 4, stride = width * channels;
+    std::vector<unsigned char> frame((size_t)stride * height, 64);
+    for (int y = height / 4; y < height * 3 / 4; ++y) {
+      for (int x = width / 6; x < width * 5 / 6; ++x) {
+        unsigned char *pixel = &frame[(size_t)y * stride + x * channels];
+        pixel[0] = pixel[1] = pixel[2] = (unsigned char)(200 + (x * 7 + y * 13) % 40);
+      }
+    }
+    
+    for (const std::vector<std::string> &documentTypes : EnabledDocumentTypesByEngine(*settings)) {
+      try {
+        std::unique_ptr<se::smartid::SessionSettings> engineSettings(settings->Clone());
+        engineSettings->SetEnabledDocumentTypes(documentTypes);
+        std::unique_ptr<se::smartid::RecognitionSession> session(
+          engine->SpawnSession(*engineSettings));
+        for (int i = 0; i < 2; ++i) {
+          session->ProcessSnapshot(frame.data(), frame.size(), width, height, stride, channels);
+        }
+      } catch (const std::exception &e) {
+        NSLog(@"Exception thrown during warm-up: %s", e.what());
+        succeeded = NO;
+      }
+    }
+    
+    const NSTimeInterval duration = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    NSLog(@"Warm-up for %s finished in %.3f s", mask.c_str(), duration);
+    if (completion) {
+      dispatch_async(dispatch_get_main_queue(), ^{
+        completion(succeeded, duration);
+      });
+    }
+  });
+}
+
+#pragma mark - Tracing
+- (void) setTracingEnabled:(BOOL)tracingEnabled {
+  if (tracingEnabled) {
+    SESIDTracer::Instance().Enable();
+  } else {
+    SESIDTracer::Instance().Disable();
+  }
+}
+
+- (BOOL) tracingEnabled {
+  return SESIDTracer::IsEnabled();
+}
+
+- (BOOL) exportTraceToFile:(NSString *)path {
+  const std::string trace = SESIDTracer::Instance().ExportChromeTrace();
+  NSData *data = [NSData dataWithBytes:trace.data() length:trace.size()];
+  NSError *error = nil;
+  if (![data writeToFile:path options:NSDataWritingAtomic error:&error]) {
+    NSLog(@"Failed to export trace to %@: %@", path, error);
+    return NO;
+  }
+  return YES;
+}
+
+- (void) clearTrace {
+  SESIDTracer::Instance().Clear();
+}
+
+#pragma mark - Engine reload
+- (void) reloadEngineWithConfigPath:(NSString *)configPath
+                         completion:(void (^)(BOOL succeeded, NSTimeInterval duration,
+                                              size_t memoryOverlap))completion {
+  const std::string path = configPath.UTF8String;
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    const size_t footprintBefore = [self memoryFootprint];
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    std::shared_ptr<se::smartid::RecognitionEngine> engine;
+    std::shared_ptr<se::smartid::SessionSettings> settings;
+    try {
+      engine = std::make_shared<se::smartid::RecognitionEngine>(path);
+      settings.reset(engine->CreateSessionSettings());
+    } catch (const std::exception &e) {
+      NSLog(@"Exception thrown during engine reload: %s", e.what());
+    }
+    
+    const NSTimeInterval duration = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    // both engines are resident at this point
+    const size_t footprintAfter = [self memoryFootprint];
+    const size_t memoryOverlap = footprintAfter > footprintBefore ?
+      footprintAfter - footprintBefore : 0;
+    
+    // engine and settings are switched on the main queue where sessions are spawned
+    dispatch_async(dispatch_get_main_queue(), ^{
+      BOOL succeeded = NO;
+      if (engine && settings) {
+        try {
+          std::lock_guard<std::mutex> lock(engineMutex_);
+          // carrying over enabled document types and options
+          settings->SetEnabledDocumentTypes(sessionSettings_->GetEnabledDocumentTypes());
+          for (const auto &option : sessionSettings_->GetOptions()) {
+            settings->SetOption(option.first, option.second);
+          }
+          engine_ = engine;
+          sessionSettings_.reset(settings->Clone());
+          succeeded = YES;
+        } catch (const std::exception &e) {
+          NSLog(@"Exception thrown during settings transfer to reloaded engine: %s", e.what());
+        }
+      }
+      if (succeeded) {
+        [self releaseSnapshotSessionsOfPreviousEngine];
+      }
+      NSLog(@"Engine reload %@ in %.3f s, memory overlap %zu bytes",
+            succeeded ? @"succeeded" : @"failed", duration, memoryOverlap);
+      if (completion) {
+        completion(succeeded, duration, memoryOverlap);
+      }
+    });
+  });
+}
+
+- (void) releaseSnapshotSessionsOfPreviousEngine {
+  // snapshot in flight holds the mutex, so not blocking the main queue on it
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    std::shared_ptr<se::smartid::RecognitionEngine> engine;
+    {
+      std::lock_guard<std::mutex> lock(engineMutex_);
+      engine = engine_;
+    }
+    std::lock_guard<std::mutex> lock(snapshotSessionMutex_);
+    if (snapshotSessionEngine_ != engine) {
+      snapshotSessions_.clear();
+      snapshotSessionSettings_.reset();
+      snapshotSessionEngine_.reset();
+    }
+  });
+}
+
+#pragma mark - Memory usage
+- (size_t) memoryFootprint {
+  task_vm_info_data_t vmInfo;
+  mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+  const kern_return_t ret = task_info(mach_task_self(), TASK_VM_INFO,
+                                      (task_info_t)&vmInfo, &count);
+  if (ret != KERN_SUCCESS) {
+    NSLog(@"%s - task_info failed: %d", __func__, ret);
+    return 0;
+  }
+  return (size_t)vmInfo.phys_footprint;
+}
+
+- (BOOL) isMemoryBudgetExceeded {
+  return self.memoryBudget != 0 && [self memoryFootprint] > self.memoryBudget;
+}
+
+- (void) releaseCachedMemory {
+  const size_t imageFileCacheUsage = [self.imageFileCache memoryUsage];
+  [self.imageFileCache removeAllImages];
+  NSLog(@"Released %zu bytes of decoded image files", imageFileCacheUsage);
+}
+
+- (std::shared_ptr<const se::smartid::Image>) cachedImageForFile:(NSString *)imageFile
+                                                    maxDimension:(int)maxDimension {
+  std::shared_ptr<const se::smartid::Image> image;
+  try {
+    image = [self.imageFileCache imageForFile:imageFile maxDimension:maxDimension];
+  } catch (const std::exception &e) {
+    NSLog(@"Exception thrown during image loading: %s", e.what());
+  }
+  // the returned image stays alive while it's used, cached ones are dropped
+  if (image && [self isMemoryBudgetExceeded]) {
+    [self releaseCachedMemory];
+  }
+  return image;
+}
+
++ (size_t) memoryUsageOfResult:(const se::smartid::RecognitionResult &)result {
+  size_t usage = sizeof(result);
+  for (const auto &field : result.GetStringFields()) {
+    const se::smartid::StringField &stringField = field.second;
+    usage += field.first.size() + sizeof(stringField);
+    const std::vector<se::smartid::OcrChar> &ocrChars = stringField.GetValue().GetOcrChars();
+    for (size_t i = 0; i < ocrChars.size(); ++i) {
+      usage += sizeof(se::smartid::OcrChar)
+             + ocrChars[i].GetOcrCharVariants().size() * sizeof(se::smartid::OcrCharVariant);
+    }
+  }
+  for (const auto &field : result.GetImageFields()) {
+    const se::smartid::Image &image = field.second.GetValue();
+    usage += field.first.size() + sizeof(field.second);
+    if (image.memown) {
+      usage += (size_t)image.stride * image.height;
+    }
+  }
+  return usage;
+}
+
+#pragma mark - Field catalog
+- (void) updateFieldCatalogWithResult:(const se::smartid::RecognitionResult &)result {
+  const std::string &documentType = result.GetDocumentType();
+  if (documentType.empty()) {
+    return;
+  }
   
-  CVPixelBufferLockBaseAddress(imageBuffer, 0);
-  uint8_t *basePtr = (uint8_t *)CVPixelBufferGetBaseAddress(imageBuffer);
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  FieldCatalogEntry &entry = fieldCatalog_[documentType];
+  for (const auto &field : result.GetStringFields()) {
+    entry.stringFieldNames.insert(field.first);
+  }
+  for (const auto &field : result.GetImageFields()) {
+    entry.imageFieldNames.insert(field.first);
+  }
   
-  const size_t bytesPerRow = CVPixelBufferGetBytesPerRow(imageBuffer);
-  const size_t width = CVPixelBufferGetWidth(imageBuffer);
-  const size_t height = CVPixelBufferGetHeight(imageBuffer);
-  const size_t channels = 4; // assuming BGRA
+  const std::vector<se::smartid::SegmentationResult> &segmentationResults =
+    result.GetSegmentationResults();
+  for (size_t i = 0; i < segmentationResults.size(); ++i) {
+    const se::smartid::SegmentationResult &segmentation = segmentationResults[i];
+    for (const auto &zone : segmentation.GetZoneQuadrangles()) {
+      if (entry.zoneFieldNames.find(zone.first) == entry.zoneFieldNames.end()) {
+        entry.zoneFieldNames[zone.first] = segmentation.GetZoneFieldName(zone.first);
+      }
+    }
+  }
+}
+
+- (std::vector<std::string>) catalogedDocumentTypes {
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  std::vector<std::string> documentTypes;
+  for (const auto &entry : fieldCatalog_) {
+    documentTypes.push_back(entry.first);
+  }
+  return documentTypes;
+}
+
+- (std::vector<std::string>) catalogedStringFieldNamesForDocumentType:(const std::string &)documentType {
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  const auto it = fieldCatalog_.find(documentType);
+  if (it == fieldCatalog_.end()) {
+    return std::vector<std::string>();
+  }
+  return std::vector<std::string>(it->second.stringFieldNames.begin(),
+                                  it->second.stringFieldNames.end());
+}
+
+- (std::vector<std::string>) catalogedImageFieldNamesForDocumentType:(const std::string &)documentType {
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  const auto it = fieldCatalog_.find(documentType);
+  if (it == fieldCatalog_.end()) {
+    return std::vector<std::string>();
+  }
+  return std::vector<std::string>(it->second.imageFieldNames.begin(),
+                                  it->second.imageFieldNames.end());
+}
+
+- (std::map<std::string, std::string>) catalogedZoneFieldNamesForDocumentType:(const std::string &)documentType {
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  const auto it = fieldCatalog_.find(documentType);
+  if (it == fieldCatalog_.end()) {
+    return std::map<std::string, std::string>();
+  }
+  return it->second.zoneFieldNames;
+}
+
+- (BOOL) fieldsMask:(const std::string &)fieldsMask
+    matchesCatalogForDocumentType:(const std::string &)documentType {
+  std::lock_guard<std::mutex> lock(fieldCatalogMutex_);
+  const auto it = fieldCatalog_.find(documentType);
+  if (it == fieldCatalog_.end()) {
+    return NO;
+  }
+  for (const std::string &name : it->second.stringFieldNames) {
+    if (MatchesWildcard(name, fieldsMask)) {
+      return YES;
+    }
+  }
+  for (const std::string &name : it->second.imageFieldNames) {
+    if (MatchesWildcard(name, fieldsMask)) {
+      return YES;
+    }
+  }
+  return NO;
+}
+
+#pragma mark - Image field store
+- (void) storeImageFieldsOfResult:(se::smartid::RecognitionResult &)result {
+  const BOOL deliversIntermediateImageFields = self.deliversIntermediateImageFields;
+  if (deliversIntermediateImageFields && !self.collectsBestImageFields) {
+    return;
+  }
+  
+  std::map<std::string, se::smartid::ImageField> &imageFields = result.GetImageFields();
+  for (const auto &field : imageFields) {
+    imageFieldStore_.Update(field.second);
+  }
+  
+  if (deliversIntermediateImageFields) {
+    return;
+  }
+  
+  if (!result.IsTerminal()) {
+    imageFields.clear();
+    return;
+  }
+  
+  for (auto &field : imageFields) {
+    const SESIDImageFieldStore::ImageFieldHandle best = imageFieldStore_.Get(field.first);
+    if (best) {
+      field.second = *best;
+    }
+  }
+}
+
+- (SESIDImageFieldStore::ImageFieldHandle) bestImageFieldWithName:(const std::string &)name {
+  return imageFieldStore_.Get(name);
+}
+
+#pragma mark - OCR alternatives
+- (void) trimOcrCharVariantsInResult:(se::smartid::RecognitionResult &)result {
+  const size_t maxVariants = self.maxOcrCharVariants;
+  if (maxVariants == 0) {
+    return;
+  }
+  
+  const auto byConfidence = [](const se::smartid::OcrCharVariant &lhs,
+                                const se::smartid::OcrCharVariant &rhs) {
+    return lhs.GetConfidence() > rhs.GetConfidence();
+  };
+  
+  std::vector<se::smartid::OcrCharVariant> trimmedVariants; // reused for all chars
+  std::map<std::string, se::smartid::StringField> &stringFields = result.GetStringFields();
+  for (auto &field : stringFields) {
+    // StringField can't be built from OcrString value and raw value, so fields
+    // with raw value are kept untrimmed instead of losing it
+    if (!field.second.GetRawValue().GetOcrChars().empty()) {
+      continue;
+    }
+    
+    const std::vector<se::smartid::OcrChar> &ocrChars = field.second.GetValue().GetOcrChars();
+    bool needsTrimming = false;
+    for (size_t i = 0; i < ocrChars.size() && !needsTrimming; ++i) {
+      needsTrimming = ocrChars[i].GetOcrCharVariants().size() > maxVariants;
+    }
+    if (!needsTrimming) {
+      continue;
+    }
+    
+    // allocated only once some field exceeds the limit
+    trimmedVariants.resize(maxVariants);
+    std::vector<se::smartid::OcrChar> trimmedChars;
+    trimmedChars.reserve(ocrChars.size());
+    for (size_t i = 0; i < ocrChars.size(); ++i) {
+      const std::vector<se::smartid::OcrCharVariant> &variants = ocrChars[i].GetOcrCharVariants();
+      if (variants.size() > maxVariants) {
+        // copying only the best variants instead of the whole vector
+        std::partial_sort_copy(variants.begin(), variants.end(),
+                               trimmedVariants.begin(), trimmedVariants.end(), byConfidence);
+        trimmedChars.push_back(se::smartid::OcrChar(trimmedVariants,
+                                                    ocrChars[i].IsHighlighted(),
+                                                    ocrChars[i].IsCorrected()));
+      } else {
+        trimmedChars.push_back(ocrChars[i]);
+      }
+    }
+    
+    field.second = se::smartid::StringField(field.second.GetName(),
+                                            se::smartid::OcrString(trimmedChars),
+                                            field.second.IsAccepted(),
+                                            field.second.GetConfidence());
+  }
+}
+
+#pragma mark - Field masks
+- (void) warnIfFieldsMaskMatchesNoCatalogedField:(const std::string &)fieldsMask {
+  // catalog is empty until the first document is recognized, nothing to check against
+  const std::vector<std::string> documentTypes = [self catalogedDocumentTypes];
+  for (const std::string &documentType : documentTypes) {
+    if ([self fieldsMask:fieldsMask matchesCatalogForDocumentType:documentType]) {
+      return;
+    }
+  }
+  if (!documentTypes.empty()) {
+    NSLog(@"Fields mask %s matches no field of recognized document types", fieldsMask.c_str());
+  }
+}
+
+- (std::shared_ptr<const FieldsMasks>) fieldsMasks {
+  std::lock_guard<std::mutex> lock(fieldsMasksMutex_);
+  return fieldsMasks_;
+}
+
+- (void) addIncludedFieldsMask:(const std::string &)fieldsMask {
+  [self warnIfFieldsMaskMatchesNoCatalogedField:fieldsMask];
+  std::lock_guard<std::mutex> lock(fieldsMasksMutex_);
+  std::shared_ptr<FieldsMasks> masks = std::make_shared<FieldsMasks>(*fieldsMasks_);
+  masks->included.push_back(fieldsMask);
+  fieldsMasks_ = masks;
+}
+
+- (void) addExcludedFieldsMask:(const std::string &)fieldsMask {
+  [self warnIfFieldsMaskMatchesNoCatalogedField:fieldsMask];
+  std::lock_guard<std::mutex> lock(fieldsMasksMutex_);
+  std::shared_ptr<FieldsMasks> masks = std::make_shared<FieldsMasks>(*fieldsMasks_);
+  masks->excluded.push_back(fieldsMask);
+  fieldsMasks_ = masks;
+}
+
+- (void) resetFieldsMasks {
+  std::lock_guard<std::mutex> lock(fieldsMasksMutex_);
+  fieldsMasks_ = std::make_shared<const FieldsMasks>();
+}
+
+- (BOOL) isFieldEnabled:(const std::string &)fieldName {
+  return [self fieldsMasks]->IsFieldEnabled(fieldName);
+}
+
+- (std::unique_ptr<se::smartid::SessionSettings>) spawnSettingsFromSettings:
+    (const se::smartid::SessionSettings &)settings {
+  std::unique_ptr<se::smartid::SessionSettings> spawnSettings(settings.Clone());
+  if (!self.extractsImageFields) {
+    for (const auto &option : settings.GetOptions()) {
+      if (IsImageExtractionOption(option.first)) {
+        spawnSettings->SetOption(option.first, "false");
+      }
+    }
+  }
+  return spawnSettings;
+}
+
+- (void) applyFieldsMasksToResult:(se::smartid::RecognitionResult &)result {
+  const std::shared_ptr<const FieldsMasks> masks = [self fieldsMasks];
+  if (masks->IsEmpty()) {
+    return;
+  }
   
-  if (basePtr == 0 || bytesPerRow == 0 || width == 0 || height == 0) {
-    NSLog(@"%s - sample buffer is bad", __func__);
+  std::map<std::string, se::smartid::StringField> &stringFields = result.GetStringFields();
+  for (auto it = stringFields.begin(); it != stringFields.end();) {
+    if (masks->IsFieldEnabled(it->first)) {
+      ++it;
+    } else {
+      it = stringFields.erase(it);
+    }
   }
   
-  CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
+  std::map<std::string, se::smartid::ImageField> &imageFields = result.GetImageFields();
+  for (auto it = imageFields.begin(); it != imageFields.end();) {
+    if (masks->IsFieldEnabled(it->first)) {
+      ++it;
+    } else {
+      it = imageFields.erase(it);
+    }
+  }
+}
+
+- (se::smartid::RecognitionResult) processSampleBuffer:(CMSampleBufferRef)sampleBuffer
+                                           orientation:(se::smartid::ImageOrientation)orientation {
+  return [self processSampleBuffer:sampleBuffer orientation:orientation processed:NULL];
+}
+
+- (se::smartid::RecognitionResult) processSampleBuffer:(CMSampleBufferRef)sampleBuffer
+                                           orientation:(se::smartid::ImageOrientation)orientation
+                                             processed:(BOOL *)processed {
+  // extracting image data from sample buffer
+  uint8_t *basePtr = 0;
+  size_t bytesPerRow = 0, width = 0, height = 0;
+  const size_t channels = 4; // assuming BGRA
+  {
+    SESIDTraceScope ingestScope("ingest");
+    CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    
+    CVPixelBufferLockBaseAddress(imageBuffer, 0);
+    basePtr = (uint8_t *)CVPixelBufferGetBaseAddress(imageBuffer);
+    
+    bytesPerRow = CVPixelBufferGetBytesPerRow(imageBuffer);
+    width = CVPixelBufferGetWidth(imageBuffer);
+    height = CVPixelBufferGetHeight(imageBuffer);
+    
+    if (basePtr == 0 || bytesPerRow == 0 || width == 0 || height == 0) {
+      NSLog(@"%s - sample buffer is bad", __func__);
+    }
+    
+    CVPixelBufferUnlockBaseAddress(imageBuffer, 0);
+  }
   
   // processing extracted image data
   return [self processUncompressedImageData:basePtr
@@ -129,7 +981,9 @@
                                      height:(int)height
                                      stride:(int)bytesPerRow
                                    channels:channels
-                                orientation:orientation];
+                                        roi:se::smartid::Rectangle(0, 0, (int)width, (int)height)
+                                orientation:orientation
+                                  processed:processed];
 }
 
 - (se::smartid::RecognitionResult) processUncompressedImageData:(uint8_t *)imageData
@@ -138,15 +992,243 @@
                                                          stride:(int)stride
                                                        channels:(int)channels
                                                     orientation:(se::smartid::ImageOrientation)orientation {
+  return [self processUncompressedImageData:imageData
+                                      width:width
+                                     height:height
+                                     stride:stride
+                                   channels:channels
+                                        roi:se::smartid::Rectangle(0, 0, width, height)
+                                orientation:orientation
+                                  processed:NULL];
+}
+
+- (se::smartid::RecognitionResult) processUncompressedImageData:(uint8_t *)imageData
+                                                          width:(int)width
+                                                         height:(int)height
+                                                         stride:(int)stride
+                                                       channels:(int)channels
+                                                            roi:(const se::smartid::Rectangle &)roi
+                                                    orientation:(se::smartid::ImageOrientation)orientation
+                                                      processed:(BOOL *)processed {
+  if (processed) {
+    *processed = NO;
+  }
+  if (self.frameTimeBudget > 0 &&
+      std::chrono::steady_clock::now().time_since_epoch().count() < skipFramesUntil_) {
+    return se::smartid::RecognitionResult();
+  }
+  
+  const se::smartid::Rectangle frameRoi = IntersectRectangles(
+    roi, se::smartid::Rectangle(0, 0, width, height));
+  if (frameRoi.width <= 0 || frameRoi.height <= 0) {
+    NSLog(@"%s - roi is outside of the image", __func__);
+    return se::smartid::RecognitionResult();
+  }
+  
+  const size_t dataLength = stride * height;
+  const BOOL autoRoiEnabled = self.autoRoiEnabled;
+  const double autoRoiMargin = self.autoRoiMargin;
+  return [self processWithSession:[&](se::smartid::RecognitionSession &session) {
+    // called with session mutex held, so auto ROI state is not shared between frames in flight
+    se::smartid::Rectangle processedRoi = frameRoi;
+    if (autoRoiEnabled && autoRoiTracked_) {
+      const se::smartid::Rectangle documentRoi = IntersectRectangles(autoRoi_, frameRoi);
+      if (documentRoi.width > 0 && documentRoi.height > 0) {
+        processedRoi = documentRoi;
+      }
+    }
+    self.lastProcessedRoiFraction =
+      (double)processedRoi.width * processedRoi.height / ((double)width * height);
+    
+    se::smartid::RecognitionResult result = session.ProcessSnapshot(imageData,
+                                                                    dataLength,
+                                                                    width,
+                                                                    height,
+                                                                    stride,
+                                                                    channels,
+                                                                    processedRoi,
+                                                                    orientation);
+    autoRoiTracked_ = autoRoiEnabled &&
+      DocumentRoi(result, width, height, orientation, autoRoiMargin, autoRoi_);
+    return result;
+  } processed:processed];
+}
+
+- (se::smartid::RecognitionResult) processImageFile:(NSString *)imageFile
+                                       maxDimension:(int)maxDimension
+                                        orientation:(se::smartid::ImageOrientation)orientation {
+  std::shared_ptr<const se::smartid::Image> image = [self cachedImageForFile:imageFile
+                                                                maxDimension:maxDimension];
+  if (!image) {
+    return se::smartid::RecognitionResult();
+  }
+  
+  return [self processWithSession:[&](se::smartid::RecognitionSession &session) {
+    return session.ProcessImage(*image, orientation);
+  } processed:NULL];
+}
+
+- (se::smartid::RecognitionResult) recognizeSnapshotImage:(const se::smartid::Image &)image
+                                              maxDimension:(int)maxDimension
+                                               orientation:(se::smartid::ImageOrientation)orientation {
+  std::lock_guard<std::mutex> lock(snapshotSessionMutex_);
+  SESIDTraceScope snapshotScope("snapshot");
   try {
-    const size_t dataLength = stride * height;
-    return session_->ProcessSnapshot(imageData,
-                                     dataLength,
-                                     width,
-                                     height,
-                                     stride,
-                                     channels,
-                                     orientation);
+    std::unique_ptr<se::smartid::SessionSettings> settings;
+    std::shared_ptr<se::smartid::RecognitionEngine> engine = [self engineWithSpawnSettings:settings];
+    
+    // spawning once per engine and settings, sessions have no reporter and are reset
+    // for each image
+    const bool settingsChanged = !snapshotSessionSettings_ ||
+      snapshotSessionSettings_->GetEnabledDocumentTypes() != settings->GetEnabledDocumentTypes() ||
+      snapshotSessionSettings_->GetOptions() != settings->GetOptions();
+    if (snapshotSessions_.empty() || snapshotSessionEngine_ != engine || settingsChanged) {
+      snapshotSessions_.clear();
+      snapshotSessionSettings_.reset();
+      snapshotSessionEngine_ = engine;
+      const std::vector<std::vector<std::string> > engineDocumentTypes =
+        EnabledDocumentTypesByEngine(*settings);
+      if (engineDocumentTypes.size() <= 1) {
+        snapshotSessions_.emplace_back(engine->SpawnSession(*settings));
+      } else {
+        for (size_t i = 0; i < engineDocumentTypes.size(); ++i) {
+          std::unique_ptr<se::smartid::SessionSettings> engineSettings(settings->Clone());
+          engineSettings->SetEnabledDocumentTypes(engineDocumentTypes[i]);
+          snapshotSessions_.emplace_back(engine->SpawnSession(*engineSettings));
+        }
+      }
+      snapshotSessionSettings_ = std::move(settings);
+    } else {
+      for (size_t i = 0; i < snapshotSessions_.size(); ++i) {
+        snapshotSessions_[i]->Reset();
+      }
+    }
+    
+    const se::smartid::Image *workingImage = &image;
+    se::smartid::Image resizedImage;
+    const int largerSide = std::max(image.width, image.height);
+    if (maxDimension > 0 && largerSide > maxDimension) {
+      resizedImage = image;
+      resizedImage.Resize((int)((int64_t)image.width * maxDimension / largerSide),
+                          (int)((int64_t)image.height * maxDimension / largerSide));
+      workingImage = &resizedImage;
+    }
+    
+    // with several internal engines sessions are tried in turn until one matches
+    // a document, result of the first session is returned if none does
+    se::smartid::RecognitionResult result;
+    for (size_t i = 0; i < snapshotSessions_.size(); ++i) {
+      se::smartid::RecognitionResult sessionResult =
+        snapshotSessions_[i]->ProcessImage(*workingImage, orientation);
+      if (!sessionResult.GetMatchResults().empty()) {
+        result = sessionResult;
+        break;
+      }
+      if (i == 0) {
+        result = sessionResult;
+      }
+    }
+    result.SetIsTerminal(true);
+    
+    [self updateFieldCatalogWithResult:result];
+    [self applyFieldsMasksToResult:result];
+    [self trimOcrCharVariantsInResult:result];
+    return result;
+  } catch (const std::exception &e) {
+    NSLog(@"Exception thrown during snapshot recognition: %s", e.what());
+  }
+  return se::smartid::RecognitionResult();
+}
+
+- (se::smartid::RecognitionResult) recognizeSnapshotFile:(NSString *)imageFile
+                                             maxDimension:(int)maxDimension
+                                              orientation:(se::smartid::ImageOrientation)orientation {
+  std::shared_ptr<const se::smartid::Image> image = [self cachedImageForFile:imageFile
+                                                                maxDimension:maxDimension];
+  if (!image) {
+    return se::smartid::RecognitionResult();
+  }
+  return [self recognizeSnapshotImage:*image maxDimension:maxDimension orientation:orientation];
+}
+
+- (se::smartid::RecognitionResult) processWithSession:
+    (const std::function<se::smartid::RecognitionResult(se::smartid::RecognitionSession &)> &)process
+                                            processed:(BOOL *)processed {
+  if (processed) {
+    *processed = NO;
+  }
+  std::lock_guard<std::mutex> lock(sessionMutex_);
+  if (sessionReleaseRequested_.exchange(false)) {
+    sessions_.clear();
+    sessionsEngine_.reset();
+  }
+  if (sessions_.empty() || !self.canProcessFrames) {
+    return se::smartid::RecognitionResult();
+  }
+  
+  try {
+    // reporter callbacks are called on this thread and inherit the context
+    SESIDTracer::SetThreadContext(traceSessionId_, ++frameId_);
+    
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    se::smartid::RecognitionResult result;
+    {
+      SESIDTraceScope processScope("process");
+      result = process(*sessions_[activeSessionIndex_]);
+    }
+    const std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+    
+    const NSTimeInterval processingTime = std::chrono::duration<double>(finish - start).count();
+    self.lastFrameProcessingTime = processingTime;
+    const NSTimeInterval frameTimeBudget = self.frameTimeBudget;
+    if (frameTimeBudget > 0 && processingTime > frameTimeBudget) {
+      // skipping frames for the overrun time to keep average load within budget
+      skipFramesUntil_ = (finish + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(processingTime - frameTimeBudget))).time_since_epoch().count();
+    }
+    
+    // match results belong to the processed frame, unlike integrated document type,
+    // so a false match is forgotten after a few frames
+    const bool matched = !result.GetMatchResults().empty();
+    if (matched || result.IsTerminal()) {
+      activeSessionLocked_ = true;
+      framesWithoutMatchCount_ = 0;
+    } else if (!activeSessionLocked_ || ++framesWithoutMatchCount_ >= kRoutingUnlockFramesCount) {
+      activeSessionLocked_ = false;
+      framesWithoutMatchCount_ = 0;
+      activeSessionIndex_ = (activeSessionIndex_ + 1) % sessions_.size();
+    }
+    if (sessionReleaseRequested_.exchange(false)) {
+      sessions_.clear();
+      sessionsEngine_.reset();
+    }
+    
+    // processing was cancelled while the frame was in flight, abandoning result
+    if (!self.canProcessFrames) {
+      return se::smartid::RecognitionResult();
+    }
+    
+    SESIDTraceScope postprocessScope("postprocess");
+    SESIDMrzResultCache *mrzResultCache = self.mrzResultCache;
+    if (result.IsTerminal()) {
+      [mrzResultCache storeResult:result];
+    } else {
+      se::smartid::RecognitionResult validatedResult;
+      if ([mrzResultCache findValidatedResult:validatedResult forResult:result]) {
+        // cache keeps no images, so image fields come from the current frame
+        validatedResult.GetImageFields() = result.GetImageFields();
+        result = validatedResult;
+      }
+    }
+    
+    [self updateFieldCatalogWithResult:result];
+    [self applyFieldsMasksToResult:result];
+    [self trimOcrCharVariantsInResult:result];
+    [self storeImageFieldsOfResult:result];
+    if (processed) {
+      *processed = YES;
+    }
+    return result;
   } catch (const std::exception &e) {
     NSLog(@"Exception thrown during processing: %s", e.what());
   }
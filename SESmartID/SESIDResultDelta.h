@@ -0,0 +1,122 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <smartIdEngine/smartid_result.h>
+
+/*****************************************************************************
+ SESIDResultDelta is a difference between two consecutive recognition
+ results: changed string fields (value, raw value, acceptance or confidence),
+ new or replaced image fields, removed fields and fresh match and
+ segmentation results. Applying the delta to the previous result rebuilds
+ the current one, so only the delta needs to be transferred per frame.
+*****************************************************************************/
+
+class SESIDResultDelta {
+public:
+  /// Empty delta, applying it changes nothing but the geometry
+  SESIDResultDelta();
+
+  /// Computes delta that turns previous result into current result
+  static SESIDResultDelta Compute(const se::smartid::RecognitionResult &previous,
+                                  const se::smartid::RecognitionResult &current);
+
+  /// Applies delta to the previous result, turning it into the current one
+  void Apply(se::smartid::RecognitionResult &result) const;
+
+  /// Whether there are no field changes in the delta
+  bool HasFieldChanges() const;
+
+  const std::map<std::string, se::smartid::StringField>& GetChangedStringFields() const;
+  const std::vector<std::string>& GetRemovedStringFields() const;
+  const std::map<std::string, se::smartid::ImageField>& GetChangedImageFields() const;
+  const std::vector<std::string>& GetRemovedImageFields() const;
+
+  const std::string& GetDocumentType() const;
+  const std::vector<se::smartid::MatchResult>& GetMatchResults() const;
+  const std::vector<se::smartid::SegmentationResult>& GetSegmentationResults() const;
+  bool IsTerminal() const;
+
+private:
+  friend class SESIDResultDeltaTracker;
+
+  std::map<std::string, se::smartid::StringField> changed_string_fields_;
+  std::vector<std::string> removed_string_fields_;
+  std::map<std::string, se::smartid::ImageField> changed_image_fields_;
+  std::vector<std::string> removed_image_fields_;
+
+  std::string document_type_;
+  std::vector<se::smartid::MatchResult> match_results_;
+  std::vector<se::smartid::SegmentationResult> segmentation_results_;
+  bool is_terminal_;
+};
+
+/*****************************************************************************
+ SESIDResultDeltaTracker computes deltas of a stream of results without
+ keeping a copy of the previous result: string fields are kept as is, image
+ fields only as a pixel fingerprint, so no image is copied per frame.
+ Next() is called from the processing thread, Reset() can be called from
+ any thread and takes effect on the following Next().
+*****************************************************************************/
+
+class SESIDResultDeltaTracker {
+public:
+  SESIDResultDeltaTracker();
+
+  /// Computes delta from the previously passed result to the current one
+  SESIDResultDelta Next(const se::smartid::RecognitionResult &current);
+
+  /// Forgets the previous result, next delta is computed against an empty one
+  void Reset();
+
+private:
+  SESIDResultDeltaTracker(const SESIDResultDeltaTracker &);
+  void operator=(const SESIDResultDeltaTracker &);
+
+  struct ImageFieldFingerprint {
+    bool is_accepted;
+    double confidence;
+    int width;
+    int height;
+    int channels;
+    uint64_t pixels_hash;
+  };
+
+  static ImageFieldFingerprint Fingerprint(const se::smartid::ImageField &field);
+  static bool SameFingerprint(const ImageFieldFingerprint &lhs,
+                              const ImageFieldFingerprint &rhs);
+
+  std::map<std::string, se::smartid::StringField> string_fields_;
+  std::map<std::string, ImageFieldFingerprint> image_fields_;
+  std::atomic<bool> reset_requested_;
+};
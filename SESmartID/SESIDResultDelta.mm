@@ -0,0 +1,252 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDResultDelta.h"
+
+#include <cstring>
+
+namespace {
+
+bool SameStringField(const se::smartid::StringField &lhs, const se::smartid::StringField &rhs) {
+  return lhs.IsAccepted() == rhs.IsAccepted()
+      && lhs.GetConfidence() == rhs.GetConfidence()
+      && lhs.GetUtf8Value() == rhs.GetUtf8Value()
+      && lhs.GetUtf8RawValue() == rhs.GetUtf8RawValue();
+}
+
+bool SameImage(const se::smartid::Image &lhs, const se::smartid::Image &rhs) {
+  if (lhs.width != rhs.width || lhs.height != rhs.height || lhs.channels != rhs.channels) {
+    return false;
+  }
+  if (lhs.data == rhs.data && lhs.stride == rhs.stride) {
+    return true;
+  }
+  if (!lhs.data || !rhs.data) {
+    return false;
+  }
+  const size_t rowLength = (size_t)lhs.width * lhs.channels;
+  for (int y = 0; y < lhs.height; ++y) {
+    if (std::memcmp(lhs.data + (size_t)y * lhs.stride,
+                    rhs.data + (size_t)y * rhs.stride, rowLength) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SameImageField(const se::smartid::ImageField &lhs, const se::smartid::ImageField &rhs) {
+  return lhs.IsAccepted() == rhs.IsAccepted()
+      && lhs.GetConfidence() == rhs.GetConfidence()
+      && SameImage(lhs.GetValue(), rhs.GetValue());
+}
+
+// collects entries of current which are new or differ from previous, and keys
+// of previous which are absent in current
+template <typename Field, typename Equal>
+void DiffFields(const std::map<std::string, Field> &previous,
+                const std::map<std::string, Field> &current,
+                Equal equal,
+                std::map<std::string, Field> &changed,
+                std::vector<std::string> &removed) {
+  for (const auto &field : current) {
+    const auto it = previous.find(field.first);
+    if (it == previous.end() || !equal(it->second, field.second)) {
+      changed.insert(field);
+    }
+  }
+  for (const auto &field : previous) {
+    if (current.find(field.first) == current.end()) {
+      removed.push_back(field.first);
+    }
+  }
+}
+
+template <typename Field>
+void ApplyFields(const std::map<std::string, Field> &changed,
+                 const std::vector<std::string> &removed,
+                 std::map<std::string, Field> &fields) {
+  for (size_t i = 0; i < removed.size(); ++i) {
+    fields.erase(removed[i]);
+  }
+  for (const auto &field : changed) {
+    fields[field.first] = field.second;
+  }
+}
+
+} // namespace
+
+SESIDResultDelta::SESIDResultDelta()
+  : is_terminal_(false) {}
+
+SESIDResultDelta SESIDResultDelta::Compute(const se::smartid::RecognitionResult &previous,
+                                           const se::smartid::RecognitionResult &current) {
+  SESIDResultDelta delta;
+  DiffFields(previous.GetStringFields(), current.GetStringFields(), SameStringField,
+             delta.changed_string_fields_, delta.removed_string_fields_);
+  DiffFields(previous.GetImageFields(), current.GetImageFields(), SameImageField,
+             delta.changed_image_fields_, delta.removed_image_fields_);
+  
+  delta.document_type_ = current.GetDocumentType();
+  delta.match_results_ = current.GetMatchResults();
+  delta.segmentation_results_ = current.GetSegmentationResults();
+  delta.is_terminal_ = current.IsTerminal();
+  return delta;
+}
+
+void SESIDResultDelta::Apply(se::smartid::RecognitionResult &result) const {
+  ApplyFields(changed_string_fields_, removed_string_fields_, result.GetStringFields());
+  ApplyFields(changed_image_fields_, removed_image_fields_, result.GetImageFields());
+  
+  result.SetDocumentType(document_type_);
+  result.SetMatchResults(match_results_);
+  result.SetSegmentationResults(segmentation_results_);
+  result.SetIsTerminal(is_terminal_);
+}
+
+bool SESIDResultDelta::HasFieldChanges() const {
+  return !changed_string_fields_.empty() || !removed_string_fields_.empty()
+      || !changed_image_fields_.empty() || !removed_image_fields_.empty();
+}
+
+const std::map<std::string, se::smartid::StringField>&
+SESIDResultDelta::GetChangedStringFields() const {
+  return changed_string_fields_;
+}
+
+const std::vector<std::string>& SESIDResultDelta::GetRemovedStringFields() const {
+  return removed_string_fields_;
+}
+
+const std::map<std::string, se::smartid::ImageField>&
+SESIDResultDelta::GetChangedImageFields() const {
+  return changed_image_fields_;
+}
+
+const std::vector<std::string>& SESIDResultDelta::GetRemovedImageFields() const {
+  return removed_image_fields_;
+}
+
+const std::string& SESIDResultDelta::GetDocumentType() const {
+  return document_type_;
+}
+
+const std::vector<se::smartid::MatchResult>& SESIDResultDelta::GetMatchResults() const {
+  return match_results_;
+}
+
+const std::vector<se::smartid::SegmentationResult>&
+SESIDResultDelta::GetSegmentationResults() const {
+  return segmentation_results_;
+}
+
+bool SESIDResultDelta::IsTerminal() const {
+  return is_terminal_;
+}
+
+SESIDResultDeltaTracker::SESIDResultDeltaTracker()
+  : reset_requested_(false) {}
+
+SESIDResultDelta SESIDResultDeltaTracker::Next(const se::smartid::RecognitionResult &current) {
+  if (reset_requested_.exchange(false)) {
+    string_fields_.clear();
+    image_fields_.clear();
+  }
+  
+  SESIDResultDelta delta;
+  const std::map<std::string, se::smartid::StringField> &stringFields = current.GetStringFields();
+  DiffFields(string_fields_, stringFields, SameStringField,
+             delta.changed_string_fields_, delta.removed_string_fields_);
+  for (size_t i = 0; i < delta.removed_string_fields_.size(); ++i) {
+    string_fields_.erase(delta.removed_string_fields_[i]);
+  }
+  for (const auto &field : delta.changed_string_fields_) {
+    string_fields_[field.first] = field.second;
+  }
+  
+  const std::map<std::string, se::smartid::ImageField> &imageFields = current.GetImageFields();
+  std::map<std::string, ImageFieldFingerprint> fingerprints;
+  for (const auto &field : imageFields) {
+    const ImageFieldFingerprint fingerprint = Fingerprint(field.second);
+    const auto it = image_fields_.find(field.first);
+    if (it == image_fields_.end() || !SameFingerprint(it->second, fingerprint)) {
+      delta.changed_image_fields_.insert(field);
+    }
+    fingerprints.insert(std::make_pair(field.first, fingerprint));
+  }
+  for (const auto &field : image_fields_) {
+    if (imageFields.find(field.first) == imageFields.end()) {
+      delta.removed_image_fields_.push_back(field.first);
+    }
+  }
+  image_fields_.swap(fingerprints);
+  
+  delta.document_type_ = current.GetDocumentType();
+  delta.match_results_ = current.GetMatchResults();
+  delta.segmentation_results_ = current.GetSegmentationResults();
+  delta.is_terminal_ = current.IsTerminal();
+  return delta;
+}
+
+void SESIDResultDeltaTracker::Reset() {
+  reset_requested_ = true;
+}
+
+SESIDResultDeltaTracker::ImageFieldFingerprint
+SESIDResultDeltaTracker::Fingerprint(const se::smartid::ImageField &field) {
+  const se::smartid::Image &image = field.GetValue();
+  ImageFieldFingerprint fingerprint;
+  fingerprint.is_accepted = field.IsAccepted();
+  fingerprint.confidence = field.GetConfidence();
+  fingerprint.width = image.width;
+  fingerprint.height = image.height;
+  fingerprint.channels = image.channels;
+  
+  // FNV-1a over visible pixels, row padding is skipped
+  uint64_t hash = 14695981039346656037ULL;
+  if (image.data) {
+    const size_t rowLength = (size_t)image.width * image.channels;
+    for (int y = 0; y < image.height; ++y) {
+      const unsigned char *row = (const unsigned char *)image.data + (size_t)y * image.stride;
+      for (size_t x = 0; x < rowLength; ++x) {
+        hash = (hash ^ row[x]) * 1099511628211ULL;
+      }
+    }
+  }
+  fingerprint.pixels_hash = hash;
+  return fingerprint;
+}
+
+bool SESIDResultDeltaTracker::SameFingerprint(const ImageFieldFingerprint &lhs,
+                                              const ImageFieldFingerprint &rhs) {
+  return lhs.is_accepted == rhs.is_accepted
+      && lhs.confidence == rhs.confidence
+      && lhs.width == rhs.width
+      && lhs.height == rhs.height
+      && lhs.channels == rhs.channels
+      && lhs.pixels_hash == rhs.pixels_hash;
+}
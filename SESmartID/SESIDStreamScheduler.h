@@ -0,0 +1,148 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <smartIdEngine/smartid_engine.h>
+
+#include "SESIDSessionHandle.h"
+
+/*****************************************************************************
+ SESIDStreamScheduler serves many video streams, each with its own
+ se::smartid::RecognitionSession, on a fixed pool of worker threads.
+ 
+ Frames are tagged with stream id and deadline. Streams are served in
+ round-robin order with at most one frame of a stream in flight (sessions
+ are not thread-safe), frames which missed their deadline are dropped before
+ processing, and the oldest frame is dropped when stream queue is full.
+*****************************************************************************/
+
+class SESIDStreamScheduler {
+public:
+  typedef std::chrono::steady_clock Clock;
+  typedef std::function<void(const std::string &stream_id,
+                             const se::smartid::RecognitionResult &result)> ResultCallback;
+
+  /// Per-stream queue and latency metrics
+  struct StreamMetrics {
+    StreamMetrics();
+
+    size_t queue_depth;        ///< frames waiting for processing
+    size_t processed_frames;   ///< frames processed successfully
+    size_t dropped_frames;     ///< frames dropped due to deadline or full queue
+    double average_latency_ms; ///< average time from submission to result
+    double max_latency_ms;     ///< maximal time from submission to result
+  };
+
+  /**
+   * @brief Starts worker threads
+   * @param workers_count - number of worker threads, hardware concurrency if 0
+   * @param max_queue_depth - maximal number of waiting frames per stream
+   * @param callback - called on a worker thread for each processed frame
+   */
+  SESIDStreamScheduler(size_t workers_count, size_t max_queue_depth,
+                       const ResultCallback &callback);
+
+  /// Stops worker threads, waiting frames are discarded
+  ~SESIDStreamScheduler();
+
+  /**
+   * @brief Adds a stream, scheduler takes ownership of the session
+   * @throws std::invalid_argument if stream with such id already exists
+   */
+  void AddStream(const std::string &stream_id, SESIDSessionHandle session);
+
+  /// Removes a stream, its session is destroyed after the frame in flight
+  void RemoveStream(const std::string &stream_id);
+
+  /**
+   * @brief Queues a copy of the frame for processing, the copy is made once
+   *        and shared until the frame is processed or dropped
+   * @return false if there is no such stream or deadline has already passed
+   */
+  bool SubmitFrame(const std::string &stream_id,
+                   const se::smartid::Image &frame,
+                   Clock::time_point deadline,
+                   se::smartid::ImageOrientation orientation = se::smartid::Landscape);
+
+  /// Metrics of a stream, default metrics if there is no such stream
+  StreamMetrics GetStreamMetrics(const std::string &stream_id) const;
+
+  /// Total number of waiting frames across all streams
+  size_t GetTotalQueueDepth() const;
+
+private:
+  struct Frame {
+    std::shared_ptr<const se::smartid::Image> image;
+    se::smartid::ImageOrientation orientation;
+    Clock::time_point submitted;
+    Clock::time_point deadline;
+  };
+
+  struct Stream {
+    Stream();
+
+    SESIDSessionHandle session;
+    std::deque<Frame> frames;
+    bool busy;
+    StreamMetrics metrics;
+  };
+
+  void WorkerLoop();
+
+  /// Picks next frame in round-robin order, must be called with mutex_ held
+  bool TakeNextFrame(std::string &stream_id, std::shared_ptr<Stream> &stream, Frame &frame);
+
+  /// Drops frames which missed the deadline, must be called with mutex_ held
+  void DropExpiredFrames(Stream &stream, Clock::time_point now);
+
+  void FinishFrame(Stream &stream, const Frame &frame, bool processed);
+
+private:
+  SESIDStreamScheduler(const SESIDStreamScheduler &);
+  void operator=(const SESIDStreamScheduler &);
+
+  mutable std::mutex mutex_;
+  std::condition_variable frames_available_;
+  std::map<std::string, std::shared_ptr<Stream> > streams_;
+  std::string last_served_stream_; ///< round-robin cursor
+  std::vector<std::thread> workers_;
+  bool stopping_;
+
+  const size_t max_queue_depth_;
+  const ResultCallback callback_;
+};
@@ -0,0 +1,243 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDStreamScheduler.h"
+
+#import <Foundation/Foundation.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+SESIDStreamScheduler::StreamMetrics::StreamMetrics()
+  : queue_depth(0),
+    processed_frames(0),
+    dropped_frames(0),
+    average_latency_ms(0.0),
+    max_latency_ms(0.0) {}
+
+SESIDStreamScheduler::Stream::Stream()
+  : busy(false) {}
+
+SESIDStreamScheduler::SESIDStreamScheduler(size_t workers_count, size_t max_queue_depth,
+                                           const ResultCallback &callback)
+  : stopping_(false),
+    max_queue_depth_(std::max<size_t>(max_queue_depth, 1)),
+    callback_(callback) {
+  if (workers_count == 0) {
+    workers_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  for (size_t i = 0; i < workers_count; ++i) {
+    workers_.push_back(std::thread(&SESIDStreamScheduler::WorkerLoop, this));
+  }
+}
+
+SESIDStreamScheduler::~SESIDStreamScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  frames_available_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+}
+
+void SESIDStreamScheduler::AddStream(const std::string &stream_id,
+                                     SESIDSessionHandle session) {
+  std::shared_ptr<Stream> stream = std::make_shared<Stream>();
+  stream->session = std::move(session);
+  
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (streams_.find(stream_id) != streams_.end()) {
+    throw std::invalid_argument("Stream already exists: " + stream_id);
+  }
+  streams_[stream_id] = stream;
+}
+
+void SESIDStreamScheduler::RemoveStream(const std::string &stream_id) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+      return;
+    }
+    stream = it->second;
+    streams_.erase(it);
+  }
+  // if a worker still holds the stream, session is destroyed when it's done
+}
+
+bool SESIDStreamScheduler::SubmitFrame(const std::string &stream_id,
+                                       const se::smartid::Image &frame,
+                                       Clock::time_point deadline,
+                                       se::smartid::ImageOrientation orientation) {
+  const Clock::time_point now = Clock::now();
+  if (deadline <= now) {
+    return false;
+  }
+  
+  // copying pixels outside of the lock, queue and workers share the copy
+  std::shared_ptr<se::smartid::Image> image = std::make_shared<se::smartid::Image>(frame);
+  image->ForceMemoryOwner();
+  
+  Frame queued;
+  queued.image = image;
+  queued.orientation = orientation;
+  queued.submitted = now;
+  queued.deadline = deadline;
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+      return false;
+    }
+    Stream &stream = *it->second;
+    if (stream.frames.size() >= max_queue_depth_) {
+      stream.frames.pop_front();
+      ++stream.metrics.dropped_frames;
+    }
+    stream.frames.push_back(std::move(queued));
+    stream.metrics.queue_depth = stream.frames.size();
+  }
+  frames_available_.notify_one();
+  return true;
+}
+
+SESIDStreamScheduler::StreamMetrics SESIDStreamScheduler::GetStreamMetrics(
+    const std::string &stream_id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    return StreamMetrics();
+  }
+  return it->second->metrics;
+}
+
+size_t SESIDStreamScheduler::GetTotalQueueDepth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t depth = 0;
+  for (const auto &stream : streams_) {
+    depth += stream.second->frames.size();
+  }
+  return depth;
+}
+
+void SESIDStreamScheduler::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    std::string stream_id;
+    std::shared_ptr<Stream> stream;
+    Frame frame;
+    frames_available_.wait(lock, [&] {
+      return stopping_ || TakeNextFrame(stream_id, stream, frame);
+    });
+    if (stopping_) {
+      return;
+    }
+    
+    lock.unlock();
+    bool processed = false;
+    try {
+      const se::smartid::RecognitionResult result =
+        stream->session->ProcessImage(*frame.image, frame.orientation);
+      processed = true;
+      if (callback_) {
+        callback_(stream_id, result);
+      }
+    } catch (const std::exception &e) {
+      NSLog(@"Exception thrown during stream %s processing: %s", stream_id.c_str(), e.what());
+    }
+    lock.lock();
+    
+    FinishFrame(*stream, frame, processed);
+    // stream may have more frames now that it is not busy
+    frames_available_.notify_one();
+  }
+}
+
+bool SESIDStreamScheduler::TakeNextFrame(std::string &stream_id,
+                                         std::shared_ptr<Stream> &stream,
+                                         Frame &frame) {
+  if (streams_.empty()) {
+    return false;
+  }
+  
+  const Clock::time_point now = Clock::now();
+  
+  // starting right after the last served stream, wrapping around
+  auto it = streams_.upper_bound(last_served_stream_);
+  for (size_t visited = 0; visited < streams_.size(); ++visited, ++it) {
+    if (it == streams_.end()) {
+      it = streams_.begin();
+    }
+    Stream &candidate = *it->second;
+    if (candidate.busy) {
+      continue;
+    }
+    DropExpiredFrames(candidate, now);
+    if (candidate.frames.empty()) {
+      continue;
+    }
+    
+    stream_id = it->first;
+    stream = it->second;
+    frame = std::move(candidate.frames.front());
+    candidate.frames.pop_front();
+    candidate.metrics.queue_depth = candidate.frames.size();
+    candidate.busy = true;
+    last_served_stream_ = stream_id;
+    return true;
+  }
+  return false;
+}
+
+void SESIDStreamScheduler::DropExpiredFrames(Stream &stream, Clock::time_point now) {
+  while (!stream.frames.empty() && stream.frames.front().deadline <= now) {
+    stream.frames.pop_front();
+    ++stream.metrics.dropped_frames;
+  }
+  stream.metrics.queue_depth = stream.frames.size();
+}
+
+void SESIDStreamScheduler::FinishFrame(Stream &stream, const Frame &frame, bool processed) {
+  stream.busy = false;
+  if (!processed) {
+    return;
+  }
+  
+  const double latency_ms = std::chrono::duration<double, std::milli>(
+    Clock::now() - frame.submitted).count();
+  StreamMetrics &metrics = stream.metrics;
+  metrics.average_latency_ms = (metrics.average_latency_ms * metrics.processed_frames
+                                + latency_ms) / (metrics.processed_frames + 1);
+  metrics.max_latency_ms = std::max(metrics.max_latency_ms, latency_ms);
+  ++metrics.processed_frames;
+}
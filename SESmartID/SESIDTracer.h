@@ -0,0 +1,134 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*****************************************************************************
+ SESIDTracer records timed events of recognition stages into a fixed-size
+ lock-free ring buffer and exports them as Chrome trace-event JSON which
+ can be opened in chrome://tracing or Perfetto. Each event carries session
+ and frame ids of the thread context set by the processing code, so engine
+ callbacks called during processing are attributed to the right frame.
+ 
+ Tracing is off by default. When it is off, SESIDTraceScope costs a single
+ relaxed atomic load. When the ring is full the oldest events are
+ overwritten.
+ 
+ Event names must be string literals (pointers are stored, not copies).
+*****************************************************************************/
+
+class SESIDTracer {
+public:
+  static const size_t kDefaultCapacity = 1 << 14;
+
+  static SESIDTracer& Instance();
+
+  /// Whether events are recorded, cheap enough to be checked on every event
+  static bool IsEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// Starts recording, ring capacity (rounded up to power of two) is allocated
+  /// on the first call and can't be changed afterwards
+  void Enable(size_t capacity = kDefaultCapacity);
+  void Disable();
+
+  /// Drops recorded events
+  void Clear();
+
+  /// Session and frame ids attached to events recorded on the calling thread
+  static void SetThreadContext(uint32_t session_id, uint64_t frame_id);
+
+  /// Records event with duration (Chrome trace "X" phase)
+  void RecordComplete(const char *name, int64_t start_us, int64_t duration_us);
+
+  /// Records instant event (Chrome trace "i" phase)
+  void RecordInstant(const char *name);
+
+  /// Recorded events as Chrome trace-event JSON
+  std::string ExportChromeTrace() const;
+
+  /// Microseconds since tracer creation
+  static int64_t NowMicroseconds();
+
+private:
+  SESIDTracer();
+  SESIDTracer(const SESIDTracer &);
+  void operator=(const SESIDTracer &);
+
+  /// Ring buffer slot, fields are atomic so that reading a slot which is being
+  /// overwritten is not a data race, sequence tells whether the slot is consistent
+  struct Slot {
+    std::atomic<uint64_t> sequence; ///< 2 * index + 2 when written, odd while writing
+    std::atomic<const char *> name;
+    std::atomic<char> phase;
+    std::atomic<int64_t> start_us;
+    std::atomic<int64_t> duration_us;
+    std::atomic<uint32_t> thread_id;
+    std::atomic<uint32_t> session_id;
+    std::atomic<uint64_t> frame_id;
+  };
+
+  void Record(const char *name, char phase, int64_t start_us, int64_t duration_us);
+
+  static std::atomic<bool> enabled_;
+
+  std::mutex config_mutex_; ///< serializes Enable, Disable and Clear
+  std::unique_ptr<Slot[]> slots_storage_;
+  std::atomic<Slot *> slots_;
+  size_t capacity_;
+  std::atomic<uint64_t> next_index_;
+  std::atomic<uint64_t> cleared_index_; ///< events before this index are not exported
+};
+
+/// Records the time from construction to destruction as an event
+class SESIDTraceScope {
+public:
+  explicit SESIDTraceScope(const char *name)
+    : name_(SESIDTracer::IsEnabled() ? name : nullptr),
+      start_us_(name_ ? SESIDTracer::NowMicroseconds() : 0) {}
+
+  ~SESIDTraceScope() {
+    if (name_) {
+      SESIDTracer::Instance().RecordComplete(
+          name_, start_us_, SESIDTracer::NowMicroseconds() - start_us_);
+    }
+  }
+
+private:
+  SESIDTraceScope(const SESIDTraceScope &);
+  void operator=(const SESIDTraceScope &);
+
+  const char *name_;
+  const int64_t start_us_;
+};
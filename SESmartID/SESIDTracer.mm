@@ -0,0 +1,221 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "SESIDTracer.h"
+
+#include <pthread.h>
+
+#include <chrono>
+#include <sstream>
+
+namespace {
+
+struct ThreadContext {
+  ThreadContext() : thread_id(0), session_id(0), frame_id(0) {}
+
+  uint32_t thread_id;
+  uint32_t session_id;
+  uint64_t frame_id;
+};
+
+// pthread key instead of thread_local which is not available on 32-bit iOS 8 targets
+pthread_key_t threadContextKey;
+pthread_once_t threadContextKeyOnce = PTHREAD_ONCE_INIT;
+std::atomic<uint32_t> lastThreadId(0);
+
+void DeleteThreadContext(void *context) {
+  delete static_cast<ThreadContext *>(context);
+}
+
+void CreateThreadContextKey() {
+  pthread_key_create(&threadContextKey, DeleteThreadContext);
+}
+
+ThreadContext& CurrentThreadContext() {
+  pthread_once(&threadContextKeyOnce, CreateThreadContextKey);
+  ThreadContext *context = static_cast<ThreadContext *>(pthread_getspecific(threadContextKey));
+  if (!context) {
+    context = new ThreadContext();
+    pthread_setspecific(threadContextKey, context);
+  }
+  return *context;
+}
+
+const std::chrono::steady_clock::time_point tracerEpoch = std::chrono::steady_clock::now();
+
+// small sequential ids are easier to read in trace viewers than system thread ids
+uint32_t CurrentThreadId() {
+  ThreadContext &context = CurrentThreadContext();
+  if (context.thread_id == 0) {
+    context.thread_id = ++lastThreadId;
+  }
+  return context.thread_id;
+}
+
+void AppendEscaped(std::ostringstream &stream, const char *text) {
+  for (const char *c = text; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      stream << '\\';
+    }
+    stream << *c;
+  }
+}
+
+} // namespace
+
+std::atomic<bool> SESIDTracer::enabled_(false);
+
+SESIDTracer& SESIDTracer::Instance() {
+  static SESIDTracer tracer;
+  return tracer;
+}
+
+SESIDTracer::SESIDTracer()
+  : slots_(nullptr),
+    capacity_(0),
+    next_index_(0),
+    cleared_index_(0) {}
+
+void SESIDTracer::Enable(size_t capacity) {
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  if (!slots_storage_) {
+    capacity_ = 1;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+    slots_storage_.reset(new Slot[capacity_]);
+    for (size_t i = 0; i < capacity_; ++i) {
+      slots_storage_[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    slots_.store(slots_storage_.get(), std::memory_order_release);
+  }
+  enabled_.store(true, std::memory_order_release);
+}
+
+void SESIDTracer::Disable() {
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  enabled_.store(false, std::memory_order_release);
+}
+
+void SESIDTracer::Clear() {
+  std::lock_guard<std::mutex> lock(config_mutex_);
+  cleared_index_.store(next_index_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+void SESIDTracer::SetThreadContext(uint32_t session_id, uint64_t frame_id) {
+  ThreadContext &context = CurrentThreadContext();
+  context.session_id = session_id;
+  context.frame_id = frame_id;
+}
+
+void SESIDTracer::RecordComplete(const char *name, int64_t start_us, int64_t duration_us) {
+  Record(name, 'X', start_us, duration_us);
+}
+
+void SESIDTracer::RecordInstant(const char *name) {
+  if (IsEnabled()) {
+    Record(name, 'i', NowMicroseconds(), 0);
+  }
+}
+
+int64_t SESIDTracer::NowMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - tracerEpoch).count();
+}
+
+void SESIDTracer::Record(const char *name, char phase, int64_t start_us, int64_t duration_us) {
+  Slot *slots = slots_.load(std::memory_order_acquire);
+  if (!slots) {
+    return;
+  }
+  
+  const uint64_t index = next_index_.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index & (capacity_ - 1)];
+  
+  // seqlock-style write: odd sequence marks the slot as being written
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.phase.store(phase, std::memory_order_relaxed);
+  slot.start_us.store(start_us, std::memory_order_relaxed);
+  slot.duration_us.store(duration_us, std::memory_order_relaxed);
+  slot.thread_id.store(CurrentThreadId(), std::memory_order_relaxed);
+  const ThreadContext &context = CurrentThreadContext();
+  slot.session_id.store(context.session_id, std::memory_order_relaxed);
+  slot.frame_id.store(context.frame_id, std::memory_order_relaxed);
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+std::string SESIDTracer::ExportChromeTrace() const {
+  std::ostringstream stream;
+  stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  
+  const Slot *slots = slots_.load(std::memory_order_acquire);
+  if (slots) {
+    const uint64_t end = next_index_.load(std::memory_order_acquire);
+    uint64_t begin = cleared_index_.load(std::memory_order_acquire);
+    if (end - begin > capacity_) {
+      begin = end - capacity_;
+    }
+    
+    bool first = true;
+    for (uint64_t index = begin; index < end; ++index) {
+      const Slot &slot = slots[index & (capacity_ - 1)];
+      const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * index + 2) {
+        continue; // not written yet or already overwritten
+      }
+      const char *name = slot.name.load(std::memory_order_relaxed);
+      const char phase = slot.phase.load(std::memory_order_relaxed);
+      const int64_t start_us = slot.start_us.load(std::memory_order_relaxed);
+      const int64_t duration_us = slot.duration_us.load(std::memory_order_relaxed);
+      const uint32_t thread_id = slot.thread_id.load(std::memory_order_relaxed);
+      const uint32_t session_id = slot.session_id.load(std::memory_order_relaxed);
+      const uint64_t frame_id = slot.frame_id.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+        continue; // overwritten while reading
+      }
+      
+      stream << (first ? "" : ",") << "{\"name\":\"";
+      AppendEscaped(stream, name);
+      stream << "\",\"cat\":\"smartid\",\"ph\":\"" << phase << "\",\"ts\":" << start_us;
+      if (phase == 'X') {
+        stream << ",\"dur\":" << duration_us;
+      } else {
+        stream << ",\"s\":\"t\"";
+      }
+      stream << ",\"pid\":1,\"tid\":" << thread_id
+             << ",\"args\":{\"session\":" << session_id << ",\"frame\":" << frame_id << "}}";
+      first = false;
+    }
+  }
+  
+  stream << "]}";
+  return stream.str();
+}
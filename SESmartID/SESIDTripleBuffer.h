@@ -0,0 +1,92 @@
+/**
+ Copyright (c) 2012-2017, Smart Engines Ltd
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice,
+ this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ * Neither the name of the Smart Engines Ltd nor the names of its
+ contributors may be used to endorse or promote products derived from this
+ software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+ FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+/*****************************************************************************
+ SESIDTripleBuffer is a lock-free single-producer single-consumer channel
+ with latest-wins semantics. Producer fills its own slot and publishes it,
+ consumer takes the latest published slot whenever it is ready, values
+ published in between are overwritten. Neither side ever waits for the
+ other, so recognition thread is not blocked by presentation.
+ 
+ Slots are reused, so e.g. vectors keep their capacity and steady state
+ publishing does not allocate.
+*****************************************************************************/
+
+template <typename T>
+class SESIDTripleBuffer {
+public:
+  SESIDTripleBuffer()
+    : write_index_(0),
+      read_index_(1),
+      state_(2) {}
+
+  /// Slot owned by producer, fill it and call Publish()
+  T& WriteBuffer() {
+    return buffers_[write_index_];
+  }
+
+  /// Publishes producer slot and takes a free one instead, contents of the new
+  /// slot are stale. Returns false if previous published value was not consumed
+  bool Publish() {
+    const uint8_t previous = state_.exchange(
+        static_cast<uint8_t>(write_index_ | kDirtyBit), std::memory_order_acq_rel);
+    write_index_ = previous & kIndexMask;
+    return (previous & kDirtyBit) == 0;
+  }
+
+  /// Takes the latest published value into consumer slot,
+  /// returns false if nothing was published since the previous call
+  bool Consume() {
+    if ((state_.load(std::memory_order_relaxed) & kDirtyBit) == 0) {
+      return false;
+    }
+    const uint8_t previous = state_.exchange(read_index_, std::memory_order_acq_rel);
+    read_index_ = previous & kIndexMask;
+    return true;
+  }
+
+  /// Slot owned by consumer, valid until the next Consume()
+  const T& ReadBuffer() const {
+    return buffers_[read_index_];
+  }
+
+private:
+  SESIDTripleBuffer(const SESIDTripleBuffer &);
+  void operator=(const SESIDTripleBuffer &);
+
+  static const uint8_t kIndexMask = 0x3;
+  static const uint8_t kDirtyBit = 0x4;
+
+  T buffers_[3];
+  uint8_t write_index_; ///< accessed by producer only
+  uint8_t read_index_; ///< accessed by consumer only
+  std::atomic<uint8_t> state_; ///< index of the middle slot and dirty bit
+};
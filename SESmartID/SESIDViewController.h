@@ -30,6 +30,9 @@
 
 #include <smartIdEngine/smartid_engine.h>
 
+#include "SESIDOverlayGeometry.h"
+#include "SESIDResultDelta.h"
+
 /*****************************************************************************
  SESIDViewController is a convenience Objective-C++ wrapper class
  for Smart ID C++ recognition library by Smart Engines.
@@ -46,6 +49,17 @@
 
 - (void) smartIdViewControllerDidCancel;
 
+@optional
+
+// called after smartIdViewControllerDidRecognizeResult: with difference from the previous result
+// of the same session, e.g. to transfer only changed fields
+- (void) smartIdViewControllerDidRecognizeResultDelta:(const SESIDResultDelta &)resultDelta;
+
+// called on main queue with quadrangles of the latest frame as soon as the document is matched
+// or segmented, before its fields are recognized; intermediate updates may be skipped
+// use overlayDocumentTypeForId: and overlayZoneNameForId: to get names for ids
+- (void) smartIdViewControllerDidUpdateOverlayGeometry:(const SESIDOverlayGeometry &)geometry;
+
 @end
 
 
@@ -58,11 +72,38 @@
 
 @property (nonatomic) float sessionTimeout; // sets result to terminal after timeout, 0 means no timeout
 
+// maximum number of OCR alternatives per character in results passed to the delegate,
+// 0 means all (default), 1 keeps only the best character
+// fields with a raw value are passed untrimmed, see SESIDRecognitionCore
+@property (nonatomic) NSUInteger maxOcrCharVariants;
+
+// whether image fields are passed in non-terminal results, YES by default
+// if NO, terminal result contains the best (by confidence and sharpness) version
+// of each image field collected during the session
+@property (nonatomic) BOOL deliversIntermediateImageFields;
+
+// time budget for a single frame in seconds, 0 means no budget (default)
+// after a frame exceeds the budget following frames are skipped for the overrun time
+@property (nonatomic) NSTimeInterval frameTimeBudget;
+
+// soft memory budget in bytes, 0 means no budget (default)
+// session is released when controller disappears with budget exceeded or on memory warning
+@property (nonatomic) size_t memoryBudget;
+
+// if YES, frames following a matched one are processed only around the document,
+// see SESIDRecognitionCore, NO by default
+@property (nonatomic) BOOL autoRoiEnabled;
+
+// records timed events of recognition stages for exportTraceToFile:, NO by default
+@property (nonatomic) BOOL tracingEnabled;
+
 @property (nonatomic) UIButton *cancelButton; // cancels scanning, user is able to modify it
 
 - (id) init;
 
 // getter for mutable recognition session settings reference, change them if needed
+// on the main queue only; the reference is invalidated by engine reload and changes made
+// through it are not synchronized with background work, prefer the methods below
 - (se::smartid::SessionSettings &) sessionSettings;
 
 // important methods for enabling document types for recognition session
@@ -74,10 +115,35 @@
 
 // actual document types without wildcard expressions
 - (void) setEnabledDocumentTypes:(const std::vector<std::string> &)documentTypes;
-- (const std::vector<std::string> &) enabledDocumentTypes;
-
-// list of supported document groups that can be enabled together
-- (const std::vector<std::vector<std::string> > &) supportedDocumentTypes;
+- (std::vector<std::string>) enabledDocumentTypes;
+
+// list of supported document groups, each group corresponds to a single internal engine
+// if types of several groups are enabled, a session is spawned for each group and frames
+// are routed between them one at a time until a document is matched, routing resumes
+// if the matched document is lost for several frames
+- (std::vector<std::vector<std::string> >) supportedDocumentTypes;
+
+// prepares recognition of document types matching the mask in background to make
+// the first frame as fast as the following ones, call before presenting the controller
+- (void) warmUpDocumentTypesMask:(const std::string &)documentTypesMask
+                      completion:(void (^)(BOOL succeeded, NSTimeInterval duration))completion;
+
+// names for ids used in SESIDOverlayGeometry, empty if id is unknown
+- (std::string) overlayDocumentTypeForId:(int)documentTypeId;
+- (std::string) overlayZoneNameForId:(int)zoneId;
+
+// field masks for results passed to the delegate, wildcard expressions can be used
+// e.g. include "full_mrz" and "mrz_*" to get only MRZ fields, exclude "photo" to drop photo
+// by default all fields are passed
+- (void) addIncludedFieldsMask:(const std::string &)fieldsMask;
+- (void) addExcludedFieldsMask:(const std::string &)fieldsMask;
+- (void) resetFieldsMasks;
+
+// writes recorded events as Chrome trace-event JSON, e.g. for chrome://tracing or Perfetto
+- (BOOL) exportTraceToFile:(NSString *)path;
+
+// physical memory footprint of the process in bytes, see SESIDRecognitionCore
+- (size_t) memoryFootprint;
 
 // convert se::smartid::Image to UIImage e.g. for display purposes
 + (UIImage *) uiImageFromSmartIdImage:(const se::smartid::Image &)image;
@@ -33,6 +33,11 @@
 
 #import "SESIDRoiOverlayView.h"
 #import "SESIDQuadrangleView.h"
+#import "SESIDTripleBuffer.h"
+#import "SESIDTracer.h"
+
+#include <algorithm>
+#include <atomic>
 
 // SmartIDResultReporter
 struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
@@ -40,6 +45,17 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
   
   int processedFramesCount;
   
+  // overlay geometry is passed to main queue without blocking recognition,
+  // main queue draws only the latest one
+  SESIDOverlayGeometryBuilder geometryBuilder;
+  SESIDTripleBuffer<SESIDOverlayGeometry> overlayGeometry;
+  std::atomic<bool> overlayUpdateScheduled;
+  
+  SmartIDResultReporter();
+  bool NeedsOverlayGeometry() const;
+  void PublishOverlayGeometry();
+  void ScheduleOverlayUpdate();
+  
   virtual void SnapshotRejected() override;
   virtual void DocumentMatched(
     const std::vector<se::smartid::MatchResult>& match_results) override;
@@ -53,6 +69,12 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
 // SESIDViewController
 @interface SESIDViewController () <AVCaptureVideoDataOutputSampleBufferDelegate> {
   SmartIDResultReporter resultReporter_;
+  
+  SESIDResultDeltaTracker resultDeltaTracker_; // used only for result delta delegate method
+  
+  // part of the latest overlay geometry which is already drawn
+  uint64_t drawnGeometryFrameId_;
+  int drawnGeometryQuadranglesCount_;
 }
 
 @property (nonatomic) SESIDCameraManager *cameraManager;
@@ -197,22 +219,39 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
     self.roiOverlayView.backgroundColor = [UIColor clearColor];
   });
   
+  resultDeltaTracker_.Reset();
   [self.recognitionCore initializeSessionWithReporter:&resultReporter_];
 }
 
 - (void) viewWillDisappear:(BOOL)animated {
-  self.recognitionCore.canProcessFrames = NO;
+  [self.recognitionCore cancelProcessing];
 }
 
 - (void) viewDidDisappear:(BOOL)animated {
   dispatch_async(dispatch_get_main_queue(), ^{
     [self.cameraManager stopCaptureSession];
   });
+  
+  if ([self.recognitionCore isMemoryBudgetExceeded]) {
+    [self.recognitionCore releaseCachedMemory];
+    [self.recognitionCore releaseSession];
+  }
+}
+
+- (void) didReceiveMemoryWarning {
+  [super didReceiveMemoryWarning];
+  
+  [self.recognitionCore releaseCachedMemory];
+  
+  // session will be spawned again in viewDidAppear:
+  if (!self.recognitionCore.canProcessFrames) {
+    [self.recognitionCore releaseSession];
+  }
 }
 
 #pragma mark - User interaction
 - (void) cancelButtonPressed {
-  self.recognitionCore.canProcessFrames = NO;
+  [self.recognitionCore cancelProcessing];
   
   [self.delegate smartIdViewControllerDidCancel];
 }
@@ -224,33 +263,114 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
 
 - (void) setSessionTimeout:(float)sessionTimeout {
   NSString *str = [[NSNumber numberWithFloat:sessionTimeout] stringValue];
-  self.recognitionCore.sessionSettings.SetOption("common.sessionTimeout", str.UTF8String);
+  [self.recognitionCore setSessionOption:"common.sessionTimeout" value:str.UTF8String];
 }
 
 - (float) sessionTimeout {
-  std::string str = self.recognitionCore.sessionSettings.GetOption("common.sessionTimeout");
+  std::string str = [self.recognitionCore sessionOption:"common.sessionTimeout"];
   float timeout = [[NSString stringWithUTF8String:str.c_str()] floatValue];
   return timeout;
 }
 
+- (void) setMaxOcrCharVariants:(NSUInteger)maxOcrCharVariants {
+  self.recognitionCore.maxOcrCharVariants = maxOcrCharVariants;
+}
+
+- (NSUInteger) maxOcrCharVariants {
+  return self.recognitionCore.maxOcrCharVariants;
+}
+
+- (void) setDeliversIntermediateImageFields:(BOOL)deliversIntermediateImageFields {
+  self.recognitionCore.deliversIntermediateImageFields = deliversIntermediateImageFields;
+}
+
+- (BOOL) deliversIntermediateImageFields {
+  return self.recognitionCore.deliversIntermediateImageFields;
+}
+
+- (void) setFrameTimeBudget:(NSTimeInterval)frameTimeBudget {
+  self.recognitionCore.frameTimeBudget = frameTimeBudget;
+}
+
+- (NSTimeInterval) frameTimeBudget {
+  return self.recognitionCore.frameTimeBudget;
+}
+
+- (void) setMemoryBudget:(size_t)memoryBudget {
+  self.recognitionCore.memoryBudget = memoryBudget;
+}
+
+- (size_t) memoryBudget {
+  return self.recognitionCore.memoryBudget;
+}
+
+- (size_t) memoryFootprint {
+  return [self.recognitionCore memoryFootprint];
+}
+
 - (void) addEnabledDocumentTypesMask:(const std::string &)documentTypesMask {
-  self.recognitionCore.sessionSettings.AddEnabledDocumentTypes(documentTypesMask);
+  [self.recognitionCore addEnabledDocumentTypesMask:documentTypesMask];
 }
 
 - (void) removeEnabledDocumentTypesMask:(const std::string &)documentTypesMask {
-  self.recognitionCore.sessionSettings.RemoveEnabledDocumentTypes(documentTypesMask);
+  [self.recognitionCore removeEnabledDocumentTypesMask:documentTypesMask];
 }
 
 - (void) setEnabledDocumentTypes:(const std::vector<std::string> &)documentTypes {
-  self.recognitionCore.sessionSettings.SetEnabledDocumentTypes(documentTypes);
+  [self.recognitionCore setEnabledDocumentTypes:documentTypes];
+}
+
+- (std::vector<std::string>) enabledDocumentTypes {
+  return [self.recognitionCore enabledDocumentTypes];
+}
+
+- (std::vector<std::vector<std::string> >) supportedDocumentTypes {
+  return [self.recognitionCore supportedDocumentTypes];
+}
+
+- (void) warmUpDocumentTypesMask:(const std::string &)documentTypesMask
+                      completion:(void (^)(BOOL succeeded, NSTimeInterval duration))completion {
+  [self.recognitionCore warmUpDocumentTypesMask:documentTypesMask completion:completion];
+}
+
+- (std::string) overlayDocumentTypeForId:(int)documentTypeId {
+  return resultReporter_.geometryBuilder.GetDocumentTypeName(documentTypeId);
+}
+
+- (std::string) overlayZoneNameForId:(int)zoneId {
+  return resultReporter_.geometryBuilder.GetZoneName(zoneId);
 }
 
-- (const std::vector<std::string> &) enabledDocumentTypes {
-  return self.recognitionCore.sessionSettings.GetEnabledDocumentTypes();
+- (void) setAutoRoiEnabled:(BOOL)autoRoiEnabled {
+  self.recognitionCore.autoRoiEnabled = autoRoiEnabled;
 }
 
-- (const std::vector<std::vector<std::string> > &) supportedDocumentTypes {
-  return self.recognitionCore.sessionSettings.GetSupportedDocumentTypes();
+- (BOOL) autoRoiEnabled {
+  return self.recognitionCore.autoRoiEnabled;
+}
+
+- (void) setTracingEnabled:(BOOL)tracingEnabled {
+  self.recognitionCore.tracingEnabled = tracingEnabled;
+}
+
+- (BOOL) tracingEnabled {
+  return self.recognitionCore.tracingEnabled;
+}
+
+- (BOOL) exportTraceToFile:(NSString *)path {
+  return [self.recognitionCore exportTraceToFile:path];
+}
+
+- (void) addIncludedFieldsMask:(const std::string &)fieldsMask {
+  [self.recognitionCore addIncludedFieldsMask:fieldsMask];
+}
+
+- (void) addExcludedFieldsMask:(const std::string &)fieldsMask {
+  [self.recognitionCore addExcludedFieldsMask:fieldsMask];
+}
+
+- (void) resetFieldsMasks {
+  [self.recognitionCore resetFieldsMasks];
 }
 
 #pragma mark - Camera and Core interaction
@@ -262,16 +382,48 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
   if ([self.recognitionCore canProcessFrames]) {
     se::smartid::ImageOrientation orientation = [self currentImageOrientation];
     
+    BOOL processed = NO;
     const se::smartid::RecognitionResult result = [self.recognitionCore
                                                    processSampleBuffer:sampleBuffer
-                                                           orientation:orientation];
+                                                           orientation:orientation
+                                                             processed:&processed];
+    
+    // skipped frames (time budget, errors) carry no result to deliver, and processing
+    // could have been cancelled by user while the frame was in flight
+    if (!processed || ![self.recognitionCore canProcessFrames]) {
+      return;
+    }
+    
+    SESIDTraceScope deliveryScope("delivery");
+    
+    // delta is computed on video queue and delivered together with the result
+    id<SESIDViewControllerDelegate> delegate = self.delegate;
+    const bool resultIsEmpty = result.GetStringFields().empty() &&
+                               result.GetImageFields().empty() &&
+                               result.GetMatchResults().empty();
+    const bool deliversDelta = !resultIsEmpty &&
+      [delegate respondsToSelector:@selector(smartIdViewControllerDidRecognizeResultDelta:)];
+    SESIDResultDelta delta;
+    if (deliversDelta) {
+      delta = resultDeltaTracker_.Next(result);
+    }
     
     // processing is performed on video queue so forcing main queue
     if ([NSThread isMainThread]) {
-      [self.delegate smartIdViewControllerDidRecognizeResult:result];
+      [delegate smartIdViewControllerDidRecognizeResult:result];
+      if (deliversDelta) {
+        [delegate smartIdViewControllerDidRecognizeResultDelta:delta];
+      }
     } else {
+      // capturing pointers since block would otherwise copy the whole result
+      // (including image fields) on every frame, dispatch_sync keeps them alive
+      const se::smartid::RecognitionResult *resultPtr = &result;
+      const SESIDResultDelta *deltaPtr = &delta;
       dispatch_sync(dispatch_get_main_queue(), ^{
-        [self.delegate smartIdViewControllerDidRecognizeResult:result];
+        [delegate smartIdViewControllerDidRecognizeResult:*resultPtr];
+        if (deliversDelta) {
+          [delegate smartIdViewControllerDidRecognizeResultDelta:*deltaPtr];
+        }
       });
     }
   }
@@ -317,49 +469,117 @@ struct SmartIDResultReporter : public se::smartid::ResultReporterInterface {
   [self viewDidLayoutSubviews];
 }
 
+- (void) updateOverlayGeometry {
+  if (!self.recognitionCore.canProcessFrames || !resultReporter_.overlayGeometry.Consume()) {
+    return;
+  }
+  
+  const SESIDOverlayGeometry &geometry = resultReporter_.overlayGeometry.ReadBuffer();
+  
+  if (self.displayDocumentQuadrangle) {
+    // match and segmentation of the same frame are published separately,
+    // quadrangles drawn on the previous update are not animated again
+    int first = 0;
+    if (geometry.frame_id == drawnGeometryFrameId_) {
+      first = std::min(drawnGeometryQuadranglesCount_, geometry.quadrangles_count);
+    }
+    for (int i = first; i < geometry.quadrangles_count; ++i) {
+      const SESIDGeometryQuadrangle &quadrangle = geometry.quadrangles[i];
+      const float *p = quadrangle.points;
+      const bool isDocument = quadrangle.zone_id == SESIDGeometryQuadrangle::kDocumentZoneId;
+      [self.quadrangleView animateQuadrangle:se::smartid::Quadrangle(se::smartid::Point(p[0], p[1]),
+                                                                     se::smartid::Point(p[2], p[3]),
+                                                                     se::smartid::Point(p[4], p[5]),
+                                                                     se::smartid::Point(p[6], p[7]))
+                                       color:UIColor.greenColor
+                                       width:(isDocument ? 2.5f : 1.3f)
+                                       alpha:0.9f];
+    }
+  }
+  drawnGeometryFrameId_ = geometry.frame_id;
+  drawnGeometryQuadranglesCount_ = geometry.quadrangles_count;
+  
+  id<SESIDViewControllerDelegate> delegate = self.delegate;
+  if ([delegate respondsToSelector:@selector(smartIdViewControllerDidUpdateOverlayGeometry:)]) {
+    [delegate smartIdViewControllerDidUpdateOverlayGeometry:geometry];
+  }
+}
+
 #pragma mark SmartIDResultReporter implementation
+SmartIDResultReporter::SmartIDResultReporter()
+  : processedFramesCount(0),
+    overlayUpdateScheduled(false) {}
+
+bool SmartIDResultReporter::NeedsOverlayGeometry() const {
+  SESIDViewController *viewController = smartIdViewController;
+  return viewController.displayDocumentQuadrangle ||
+      [viewController.delegate respondsToSelector:@selector(smartIdViewControllerDidUpdateOverlayGeometry:)];
+}
+
+void SmartIDResultReporter::PublishOverlayGeometry() {
+  overlayGeometry.WriteBuffer() = geometryBuilder.GetGeometry();
+  overlayGeometry.Publish();
+  ScheduleOverlayUpdate();
+}
+
+void SmartIDResultReporter::ScheduleOverlayUpdate() {
+  // at most one pending update, it will pick up everything published before it runs
+  if (!overlayUpdateScheduled.exchange(true)) {
+    __weak SESIDViewController *viewController = smartIdViewController;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      SESIDViewController *strongViewController = viewController;
+      if (strongViewController) {
+        strongViewController->resultReporter_.overlayUpdateScheduled = false;
+        [strongViewController updateOverlayGeometry];
+      }
+    });
+  }
+}
+
 void SmartIDResultReporter::SnapshotRejected() {
 //  NSLog(@"%s", __FUNCTION__);
+  SESIDTracer::Instance().RecordInstant("snapshot_rejected");
 }
 
 void SmartIDResultReporter::DocumentMatched(
   const std::vector<se::smartid::MatchResult>& match_results) {
 //  NSLog(@"%s", __FUNCTION__);
+  SESIDTraceScope matchedScope("document_matched");
   
-  if (smartIdViewController.displayDocumentQuadrangle) {
-    for (size_t i = 0; i < match_results.size(); ++i) {
-      dispatch_sync(dispatch_get_main_queue(), ^{
-        const se::smartid::MatchResult &result = match_results[i];
-        [smartIdViewController.quadrangleView animateQuadrangle:result.GetQuadrangle()
-                                                          color:UIColor.greenColor
-                                                          width:2.5f
-                                                          alpha:0.9f];
-      });
-    }
+  if (!smartIdViewController.recognitionCore.canProcessFrames) {
+    return;
+  }
+  
+  if (NeedsOverlayGeometry()) {
+    geometryBuilder.Reset(smartIdViewController.recognitionCore.currentFrameId);
+    geometryBuilder.AddMatchResults(match_results);
+    PublishOverlayGeometry();
   }
 }
 
 void SmartIDResultReporter::DocumentSegmented(
   const std::vector<se::smartid::SegmentationResult>& segmentation_results) {
   //  NSLog(@"%s", __FUNCTION__);
+  SESIDTraceScope segmentedScope("document_segmented");
   
-  if (smartIdViewController.displayDocumentQuadrangle) {
-    for (size_t i = 0; i < segmentation_results.size(); ++i) {
-      const se::smartid::SegmentationResult &result = segmentation_results[i];
-      for (const auto &zone_quad : result.GetZoneQuadrangles()) {
-        dispatch_sync(dispatch_get_main_queue(), ^{
-          [smartIdViewController.quadrangleView animateQuadrangle:zone_quad.second
-                                                            color:UIColor.greenColor
-                                                            width:1.3f
-                                                            alpha:0.9f];
-        });
-      }
+  if (!smartIdViewController.recognitionCore.canProcessFrames) {
+    return;
+  }
+  
+  if (NeedsOverlayGeometry()) {
+    // segmentation without match of the same frame starts new geometry
+    const uint64_t frameId = smartIdViewController.recognitionCore.currentFrameId;
+    if (geometryBuilder.GetGeometry().frame_id != frameId) {
+      geometryBuilder.Reset(frameId);
     }
+    geometryBuilder.AddSegmentationResults(segmentation_results);
+    PublishOverlayGeometry();
   }
 }
 
 void SmartIDResultReporter::SnapshotProcessed(const se::smartid::RecognitionResult &result) {
 //  NSLog(@"%s %d", __FUNCTION__, processedFramesCount);
+  SESIDTracer::Instance().RecordInstant("snapshot_processed");
   ++processedFramesCount;
 }
 
@@ -59,6 +59,10 @@
   // configure optional visualization properties (they are NO by default)
   self.smartIdViewController.displayDocumentQuadrangle = YES;
   self.smartIdViewController.displayZonesQuadrangles = YES;
+  
+  // optionally prepare document types which will be enabled in showSmartIdViewController
+  // so that the first frame is processed as fast as the following ones
+  [self.smartIdViewController warmUpDocumentTypesMask:"mrz.*" completion:nil];
 }
 
 - (void) showSmartIdViewController {